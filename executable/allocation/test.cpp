@@ -0,0 +1,174 @@
+//
+// Created by yaione on 10/18/26.
+//
+
+#include <atomic>
+#include <new>
+
+#include "rmcv.h"
+
+namespace
+{
+    std::atomic<int64> allocations{0};
+    std::atomic<int64> mat_allocations{0};
+
+    /// Default allocator of cv::Mat counting the buffers it creates, which go through cv::fastMalloc and bypass
+    /// operator new.
+    class counting_allocator : public cv::MatAllocator
+    {
+    public:
+        cv::UMatData* allocate(const int dims, const int* sizes, const int type, void* data, size_t* step,
+                               const cv::AccessFlag flags, const cv::UMatUsageFlags usage) const override
+        {
+            mat_allocations.fetch_add(1, std::memory_order_relaxed);
+            return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usage);
+        }
+
+        bool allocate(cv::UMatData* data, const cv::AccessFlag flags, const cv::UMatUsageFlags usage) const override
+        {
+            return cv::Mat::getStdAllocator()->allocate(data, flags, usage);
+        }
+
+        void deallocate(cv::UMatData* data) const override
+        {
+            cv::Mat::getStdAllocator()->deallocate(data);
+        }
+    };
+}
+
+// count every allocation of the process through operator new, matrices are counted by counting_allocator
+void* operator new(const std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size ? size : 1)) return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+/// Allocations per call of a stage after a few warm-up calls, through operator new and through cv::Mat.
+template <typename Stage>
+std::pair<double, double> count_allocations(Stage stage)
+{
+    for (int i = 0; i < 3; i++) stage();
+
+    const int64 before = allocations.load(), mat_before = mat_allocations.load();
+    for (int i = 0; i < 100; i++) stage();
+    return {
+        static_cast<double>(allocations.load() - before) / 100,
+        static_cast<double>(mat_allocations.load() - mat_before) / 100
+    };
+}
+
+int main()
+{
+    counting_allocator allocator;
+    cv::Mat::setDefaultAllocator(&allocator);
+
+    // dark noisy frame with a few pairs of blue light bars
+    cv::Mat image(1024, 1280, CV_8UC3), raw(1024, 1280, CV_8UC1);
+    cv::RNG rng(0x5eed);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 48);
+    rng.fill(raw, cv::RNG::UNIFORM, 0, 256);
+    for (int i = 0; i < 6; i++)
+    {
+        const cv::Point center(200 + i * 160, 300 + i * 80);
+        rectangle(image, {center.x - 40, center.y - 20, 8, 40}, {255, 80, 40}, cv::FILLED);
+        rectangle(image, {center.x + 32, center.y - 20, 8, 40}, {255, 80, 40}, cv::FILLED);
+    }
+    const std::vector<cv::Rect> windows = {{100, 200, 300, 200}, {350, 250, 300, 200}, {900, 600, 300, 300}};
+
+    rm::preprocess_workspace workspace;
+    rm::adaptive_threshold threshold;
+    cv::Mat enhanced, calibration, normalized;
+
+    const std::vector<std::pair<std::string, std::function<void(int)>>> stages = {
+        {"binarize_color", [&](const int stripes)
+        {
+            rm::binarize_color(image, rm::CAMP_BLUE, 80, workspace, stripes);
+        }},
+        {"binarize_color adaptive", [&](const int stripes)
+        {
+            rm::binarize_color(image, rm::CAMP_BLUE, threshold, workspace, stripes);
+        }},
+        {"binarize_color windows", [&](int)
+        {
+            rm::binarize_color(image, rm::CAMP_BLUE, 80, windows, workspace);
+        }},
+        {"binarize_color adaptive windows", [&](int)
+        {
+            rm::binarize_color(image, rm::CAMP_BLUE, threshold, windows, workspace);
+        }},
+        {"binarize_bayer adaptive", [&](const int stripes)
+        {
+            rm::binarize_bayer(raw, rm::BAYER_RG, rm::CAMP_BLUE, threshold, workspace, stripes);
+        }},
+        {"binarize_bayer", [&](const int stripes)
+        {
+            rm::binarize_bayer(raw, rm::BAYER_RG, rm::CAMP_BLUE, 80, workspace, stripes);
+        }},
+        {"binarize_bayer windows", [&](int)
+        {
+            rm::binarize_bayer(raw, rm::BAYER_RG, rm::CAMP_BLUE, 80, windows, workspace);
+        }},
+        {"label_blobs", [&](const int stripes)
+        {
+            rm::binarize_color(image, rm::CAMP_BLUE, 80, workspace, stripes);
+            rm::label_blobs(workspace.binary, workspace, stripes);
+        }},
+        {"CalcGamma", [&](int)
+        {
+            rm::CalcGamma(image, calibration, 0.6f, workspace);
+        }},
+        {"AutoEnhance", [&](int)
+        {
+            image.copyTo(enhanced);
+            rm::AutoEnhance(enhanced, workspace);
+        }},
+        {"AutoBinarize", [&](int)
+        {
+            rm::AutoBinarize(image, normalized, workspace);
+        }},
+    };
+
+    // the serial steady state must not allocate at all, neither heap objects nor matrix buffers
+    bool passed = true;
+    const int threads = cv::getNumThreads();
+    cv::setNumThreads(1);
+    for (auto& [name, stage] : stages)
+    {
+        if (const auto [heap, mats] = count_allocations([&stage] { stage(1); }); heap != 0 || mats != 0)
+        {
+            std::cout << name << ": " << heap << " allocations and " << mats << " matrices per call" << std::endl;
+            passed = false;
+        }
+    }
+    std::cout << (passed ? "serial workspace passed" : "serial workspace failed") << std::endl;
+
+    // cv::findContours allocates the contour vectors, extract_color is documented as allocating and only reported
+    {
+        const auto [heap, mats] = count_allocations([&] { rm::extract_color(image, rm::CAMP_BLUE, 80, workspace); });
+        std::cout << "extract_color: " << heap << " allocations and " << mats << " matrices per call" << std::endl;
+    }
+
+    // cv::parallel_for_ wraps the stripes in a std::function and the pthreads backend allocates a job per call, these
+    // are reported but not counted as failures
+    cv::setNumThreads(threads);
+    for (auto& [name, stage] : stages)
+    {
+        const auto [heap, mats] = count_allocations([&stage] { stage(4); });
+        std::cout << name << ", 4 stripes: " << heap << " allocations and " << mats << " matrices per call"
+            << std::endl;
+    }
+
+    cv::Mat::setDefaultAllocator(nullptr);
+    return passed ? 0 : 1;
+}
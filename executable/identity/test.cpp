@@ -0,0 +1,69 @@
+//
+// Created by yaione on 10/18/26.
+//
+
+#include "rmcv.h"
+
+int main()
+{
+    bool passed = true;
+
+    // a single vote is certain, as with the softmax over the identities seen so far
+    rm::identity_histogram single;
+    single.vote(2);
+    if (auto [identity, confidence] = single.max(); identity != 2 || confidence != 1)
+    {
+        std::cout << "single vote: " << identity << " (" << confidence << ")" << std::endl;
+        passed = false;
+    }
+
+    // a track stable for a whole match, raw exp(count) used to overflow after ~700 frames
+    rm::identity_histogram histogram;
+    for (int frame = 0; frame < 210 * 60 * 7; frame++)
+    {
+        histogram.decay();
+        histogram.vote(3);
+    }
+    if (auto [identity, confidence] = histogram.max();
+        identity != 3 || !std::isfinite(confidence) || confidence <= 0.5 || confidence > 1)
+    {
+        std::cout << "stable track: " << identity << " (" << confidence << ")" << std::endl;
+        passed = false;
+    }
+
+    // a misclassified identity takes over only after it outvotes the decayed history
+    int frames = 0;
+    while (std::get<0>(histogram.max()) != 5 && frames < 1000)
+    {
+        histogram.decay();
+        histogram.vote(5);
+        frames++;
+    }
+    if (frames == 0 || frames >= 1000)
+    {
+        std::cout << "identity switch after " << frames << " frames" << std::endl;
+        passed = false;
+    }
+
+    // a lost track keeps decaying without votes, so its confidence drops towards the other identities
+    const double tracked = std::get<1>(histogram.max());
+    for (int frame = 0; frame < 25; frame++) histogram.decay();
+    if (auto [identity, confidence] = histogram.max(); identity != 5 || confidence >= tracked)
+    {
+        std::cout << "lost track: " << identity << " (" << confidence << " after " << tracked << ")" << std::endl;
+        passed = false;
+    }
+
+    // unknown identities are ignored
+    rm::identity_histogram empty;
+    empty.vote(-1);
+    empty.vote(rm::identity_histogram::labels);
+    if (std::get<0>(empty.max()) != -1)
+    {
+        std::cout << "unknown identities were counted" << std::endl;
+        passed = false;
+    }
+
+    std::cout << (passed ? "identity histogram passed" : "identity histogram failed") << std::endl;
+    return passed ? 0 : 1;
+}
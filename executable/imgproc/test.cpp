@@ -0,0 +1,282 @@
+//
+// Created by yaione on 10/18/26.
+//
+
+#include "rmcv.h"
+
+int main()
+{
+    // the fused kernel must reproduce the split, subtract, inRange and close pipeline of extract_color bit for bit
+    const cv::Size sizes[] = {{1, 1}, {3, 2}, {17, 5}, {33, 31}, {65, 64}, {641, 479}, {1280, 1024}};
+    const rm::camp camps[] = {rm::CAMP_RED, rm::CAMP_BLUE, rm::CAMP_GUIDELIGHT};
+    const int bounds[] = {-10, 0, 1, 40, 100, 128, 254, 255, 256, 300};
+    const int stripes[] = {1, 3, 8};
+
+    cv::RNG rng(0x5eed);
+    bool passed = true;
+    int cases = 0;
+    for (const auto& size : sizes)
+    {
+        for (int repeat = 0; repeat < 3; repeat++)
+        {
+            // uniform noise, and a dark frame with sparse saturated blobs which exercises the close operation
+            cv::Mat image(size, CV_8UC3);
+            if (repeat == 0) rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+            else
+            {
+                rng.fill(image, cv::RNG::UNIFORM, 0, 64);
+                for (int i = 0; i < size.area() / 50 + 1; i++)
+                {
+                    const cv::Point center(rng.uniform(0, size.width), rng.uniform(0, size.height));
+                    const cv::Scalar color(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+                    circle(image, center, rng.uniform(0, 4), color, -1);
+                }
+            }
+
+            for (const auto camp : camps)
+            {
+                for (const int bound : bounds)
+                {
+                    const cv::Mat expected = std::get<1>(rm::extract_color(image, camp, bound));
+                    for (const int count : stripes)
+                    {
+                        cv::Mat binary;
+                        rm::binarize_color(image, binary, camp, bound, count);
+                        cases++;
+
+                        if (binary.size() != expected.size() || binary.type() != expected.type() ||
+                            cv::countNonZero(binary != expected) != 0)
+                        {
+                            std::cout << size << " camp " << camp << " bound " << bound << " stripes " << count
+                                << ": masks differ" << std::endl;
+                            passed = false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    std::cout << cases << " cases, " << (passed ? "fused kernel passed" : "fused kernel failed") << std::endl;
+
+    // striped labelling must give the same components in the same order as a single stripe, whatever the seams cut
+    bool labelled = true;
+    for (const auto& size : sizes)
+    {
+        cv::Mat binary(size, CV_8UC1);
+        rng.fill(binary, cv::RNG::UNIFORM, 0, 256);
+        cv::threshold(binary, binary, 200, 255, cv::THRESH_BINARY);
+
+        const auto expected = rm::label_blobs(binary);
+        rm::preprocess_workspace workspace;
+        for (const int count : {2, 3, 7, 64})
+        {
+            rm::label_blobs(binary, workspace, count);
+            bool same = workspace.blobs.size() == expected.size();
+            for (size_t i = 0; same && i < expected.size(); i++)
+            {
+                const auto& a = workspace.blobs[i];
+                const auto& b = expected[i];
+                same = a.area == b.area && a.bounding_box == b.bounding_box && a.sum_x == b.sum_x &&
+                    a.sum_y == b.sum_y && a.sum_xx == b.sum_xx && a.sum_xy == b.sum_xy && a.sum_yy == b.sum_yy;
+            }
+            if (!same)
+            {
+                std::cout << size << " stripes " << count << ": " << workspace.blobs.size() << " components, "
+                    << expected.size() << " expected" << std::endl;
+                labelled = false;
+            }
+        }
+    }
+    std::cout << (labelled ? "striped labelling passed" : "striped labelling failed") << std::endl;
+    passed = passed && labelled;
+
+    // components and their moment ellipses against traced contours and fitted ellipses on synthetic light blobs
+    bool fitted = true;
+    {
+        cv::Mat binary = cv::Mat::zeros(640, 800, CV_8UC1);
+        std::vector<cv::RotatedRect> drawn;
+        for (int row = 0; row < 8; row++)
+        {
+            for (int col = 0; col < 10; col++)
+            {
+                const cv::Point2f center(40.0f + static_cast<float>(col) * 80 + rng.uniform(-3.0f, 3.0f),
+                                         40.0f + static_cast<float>(row) * 80 + rng.uniform(-3.0f, 3.0f));
+                const cv::Size2f size(rng.uniform(4.0f, 20.0f), rng.uniform(20.0f, 60.0f));
+                drawn.emplace_back(center, size, rng.uniform(0.0f, 180.0f));
+                ellipse(binary, drawn.back(), 255, cv::FILLED);
+            }
+        }
+
+        // the major axis direction in [0, 180), whichever side of the rect it is stored on
+        const auto major_angle = [](const cv::RotatedRect& box)
+        {
+            const float angle = box.size.height >= box.size.width ? box.angle + 90 : box.angle;
+            return std::fmod(std::fmod(angle, 180.0f) + 180.0f, 180.0f);
+        };
+        const auto similar = [](const float a, const float b)
+        {
+            return std::abs(a - b) <= 1.5f + 0.08f * std::max(a, b);
+        };
+
+        std::vector<rm::contour> contours;
+        findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+        const auto blobs = rm::label_blobs(binary);
+        if (blobs.size() != drawn.size() || contours.size() != drawn.size())
+        {
+            std::cout << blobs.size() << " components, " << contours.size() << " contours, " << drawn.size()
+                << " drawn" << std::endl;
+            fitted = false;
+        }
+
+        for (const auto& contour : contours)
+        {
+            if (!fitted) break;
+
+            const cv::Rect box = boundingRect(contour);
+            const auto blob = std::find_if(blobs.begin(), blobs.end(), [&box](const rm::blob_stats& stats)
+            {
+                return stats.bounding_box == box;
+            });
+            if (blob == blobs.end())
+            {
+                std::cout << "no component with the bounding box " << box << std::endl;
+                fitted = false;
+                break;
+            }
+
+            const auto moments = blob->ellipse();
+            const auto reference = fitEllipse(contour);
+            const float major = std::max(reference.size.width, reference.size.height);
+            const float minor = std::min(reference.size.width, reference.size.height);
+            const float difference = std::abs(major_angle(moments) - major_angle(reference));
+
+            bool same = blob->area == cv::countNonZero(binary(box)) && blob->area >= contourArea(contour) &&
+                cv::norm(moments.center - reference.center) <= 0.5 && similar(moments.size.height, major) &&
+                similar(moments.size.width, minor);
+            // the orientation of a nearly round blob is meaningless
+            if (major > minor * 1.5f) same = same && std::min(difference, 180 - difference) <= 3;
+            if (!same)
+            {
+                std::cout << "component at " << box << ": " << moments.center << " " << moments.size << " "
+                    << moments.angle << ", fitted " << reference.center << " " << reference.size << " "
+                    << reference.angle << std::endl;
+                fitted = false;
+            }
+        }
+    }
+    std::cout << (fitted ? "moment ellipses passed" : "moment ellipses failed") << std::endl;
+    passed = passed && fitted;
+
+    // time of both paths on a full frame
+    cv::Mat image(1024, 1280, CV_8UC3);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    cv::Mat binary;
+    for (const int count : stripes)
+    {
+        const auto start = cv::getTickCount();
+        for (int i = 0; i < 100; i++) rm::binarize_color(image, binary, rm::CAMP_BLUE, 80, count);
+        const double elapsed = static_cast<double>(cv::getTickCount() - start) / cv::getTickFrequency();
+        std::cout << "binarize_color, " << count << " stripes: " << elapsed * 10 << " ms per frame" << std::endl;
+    }
+    {
+        const auto start = cv::getTickCount();
+        for (int i = 0; i < 100; i++) binary = std::get<1>(rm::extract_color(image, rm::CAMP_BLUE, 80));
+        const double elapsed = static_cast<double>(cv::getTickCount() - start) / cv::getTickFrequency();
+        std::cout << "extract_color with contours: " << elapsed * 10 << " ms per frame" << std::endl;
+    }
+
+    rm::preprocess_workspace workspace;
+    rm::binarize_color(image, binary, rm::CAMP_BLUE, 200);
+    for (const int count : stripes)
+    {
+        const auto start = cv::getTickCount();
+        for (int i = 0; i < 100; i++) rm::label_blobs(binary, workspace, count);
+        const double elapsed = static_cast<double>(cv::getTickCount() - start) / cv::getTickFrequency();
+        std::cout << "label_blobs, " << count << " stripes: " << elapsed * 10 << " ms per frame" << std::endl;
+    }
+
+    // cost of the adaptive threshold over a fixed bound on a single stripe, the budget is 0.2 ms per frame, the best
+    // of several rounds is kept so that scheduling noise does not dominate the difference
+    {
+        rm::adaptive_threshold threshold;
+        const auto best_time = [](const auto& binarize)
+        {
+            double best = std::numeric_limits<double>::max();
+            for (int round = 0; round < 5; round++)
+            {
+                const auto start = cv::getTickCount();
+                for (int i = 0; i < 50; i++) binarize();
+                const double elapsed = static_cast<double>(cv::getTickCount() - start) / cv::getTickFrequency();
+                best = std::min(best, elapsed / 50 * 1000);
+            }
+            return best;
+        };
+
+        const double fixed = best_time([&] { rm::binarize_color(image, rm::CAMP_BLUE, 80, workspace); });
+        const double adaptive = best_time([&] { rm::binarize_color(image, rm::CAMP_BLUE, threshold, workspace); });
+        std::cout << "adaptive threshold: " << adaptive - fixed << " ms per frame over a fixed bound, "
+            << (adaptive - fixed <= 0.2 ? "within" : "over") << " the 0.2 ms budget" << std::endl;
+    }
+
+    // a table stays valid while tables of other factors are built
+    {
+        rm::gamma_engine gamma;
+        const cv::Mat& table = gamma.table(0.5f);
+        const uchar* data = table.ptr();
+        for (float factor = rm::gamma_engine::gamma_max; factor > 0.5f; factor -= 0.25f) gamma.table(factor);
+
+        const bool kept = table.ptr() == data && table.at<uchar>(64) == cv::saturate_cast<uchar>(
+            std::pow(64 / 255.0, 0.5) * 255.0);
+        std::cout << (kept ? "gamma tables passed" : "gamma tables failed") << std::endl;
+        passed = passed && kept;
+    }
+
+    // batched rectification against affine_correction and flatten_image on a smooth frame, the old path interpolates
+    // twice (warp to the bounding box, then resize) so only the mean difference is bounded
+    {
+        cv::Mat coarse(12, 16, CV_8UC3), image;
+        cv::RNG rng(0x5eed);
+        rng.fill(coarse, cv::RNG::UNIFORM, 0, 256);
+        resize(coarse, image, {640, 480}, 0, 0, cv::INTER_CUBIC);
+
+        std::vector<rm::armour> armours;
+        for (int i = 0; i < 6; i++)
+        {
+            const cv::Point2f center(100.0f + static_cast<float>(i) * 90, 150.0f + static_cast<float>(i) * 40);
+            const float tilt = static_cast<float>(i) * 3 - 8;
+            const rm::lightblob left({center - cv::Point2f(35, 0), {6, 30}, tilt}, rm::CAMP_BLUE);
+            const rm::lightblob right({center + cv::Point2f(35, 0), {6, 30}, tilt}, rm::CAMP_BLUE);
+            armours.emplace_back(rm::armour_candidate(left, right));
+        }
+
+        cv::Mat features;
+        rm::rectify_icons(image, armours, features);
+
+        bool rectified = features.rows == static_cast<int>(armours.size());
+        for (int i = 0; rectified && i < static_cast<int>(armours.size()); i++)
+        {
+            cv::Point2f vertices[4];
+            std::copy(armours[i].icon, armours[i].icon + 4, vertices);
+            const cv::Mat expected =
+                rm::utils::flatten_image(rm::affine_correction(image, vertices, {20, 20}), CV_32F);
+
+            const double difference = norm(features.row(i), expected, cv::NORM_L1) / static_cast<double>(expected.cols);
+            if (difference > 4)
+            {
+                std::cout << "armour " << i << ": mean difference " << difference << std::endl;
+                rectified = false;
+            }
+        }
+
+        // other depths are not sampled and leave no rows to classify
+        cv::Mat floating;
+        image.convertTo(floating, CV_32F);
+        rm::rectify_icons(floating, armours, features);
+        rectified = rectified && features.empty();
+
+        std::cout << (rectified ? "icon rectification passed" : "icon rectification failed") << std::endl;
+        passed = passed && rectified;
+    }
+
+    return passed ? 0 : 1;
+}
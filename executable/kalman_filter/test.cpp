@@ -4,8 +4,24 @@
 
 #include "rmcv.h"
 
+/// Largest difference between the state of cv::KalmanFilter and rm::kalman, relative to the magnitude of the state.
+template <typename T>
+double state_difference(const cv::Mat& expected, const cv::Matx<T, 6, 1>& state)
+{
+    double difference = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        const double value = expected.at<T>(i);
+        difference = std::max(difference, std::abs(value - state(i)) / (1 + std::abs(value)));
+    }
+    return difference;
+}
+
 int main()
 {
+    bool passed = true;
+    double difference_max = 0;
+
     cv::KalmanFilter KF(6, 6, 0);
 
     setIdentity(KF.measurementMatrix);
@@ -23,6 +39,11 @@ int main()
         0, 0, 0, 0, 1, 0,
         0, 0, 0, 0, 0, 1);
 
+    // the fixed size filter is fed the same measurements and must follow cv::KalmanFilter, including the first
+    // correction which sees a zero prior covariance
+    rm::kalman<6, 6, float> filter(5e-3f, 0.5f, 0.05f);
+    cv::Matx<float, 6, 1> fixed_measurement;
+
     bool firstKF = true;
 
     auto function = [](const float& t) -> float
@@ -52,6 +73,9 @@ int main()
             measurement.at<float>(2) = function(t);
 
             KF.correct(measurement);
+            measurement.copyTo(fixed_measurement);
+            filter.correct(fixed_measurement);
+            difference_max = std::max(difference_max, state_difference<float>(KF.statePost, filter.state));
             firstKF = false;
 
             t_last = t;
@@ -66,6 +90,8 @@ int main()
             KF.transitionMatrix.at<float>(2, 5) = dt;
 
             KF.predict();
+            filter.transition = cv::Matx<float, 6, 6>(KF.transitionMatrix);
+            filter.predict();
 
             measurement.at<float>(3) = (value - measurement.at<float>(0)) / dt;
             measurement.at<float>(4) = (value - measurement.at<float>(1)) / dt;
@@ -78,10 +104,75 @@ int main()
             t_last = t;
 
             KF.correct(measurement);
+            measurement.copyTo(fixed_measurement);
+            filter.correct(fixed_measurement);
+            difference_max = std::max(difference_max, state_difference<float>(KF.statePost, filter.state));
 
             auto test = cv::Mat(KF.transitionMatrix * KF.statePost);
             std::cout << test << std::endl;
             std::cout << 2 * t << std::endl;
         }
     }
+
+    if (difference_max > 1e-3)
+    {
+        std::cout << "fixed size filter deviates from cv::KalmanFilter by " << difference_max << std::endl;
+        passed = false;
+    }
+    std::cout << (passed ? "equivalence passed" : "equivalence failed") << std::endl;
+
+    // benchmark: predict and correct of the armour filter (double, 6 states) on a fixed time step
+    {
+        constexpr int steps = 100000;
+        constexpr double dt = 0.01;
+
+        cv::KalmanFilter reference(6, 6, 0, CV_64F);
+        setIdentity(reference.measurementMatrix);
+        setIdentity(reference.processNoiseCov, cv::Scalar::all(5e-5));
+        setIdentity(reference.measurementNoiseCov, cv::Scalar::all(0.5));
+        setIdentity(reference.errorCovPost, cv::Scalar::all(0.05));
+        setIdentity(reference.transitionMatrix);
+        for (int i = 0; i < 3; i++) reference.transitionMatrix.at<double>(i, i + 3) = dt;
+
+        rm::kalman<6, 6> fixed(5e-5, 0.5, 0.05);
+        for (int i = 0; i < 3; i++) fixed.transition(i, i + 3) = dt;
+
+        cv::RNG rng(0x5eed);
+        std::vector<cv::Matx<double, 6, 1>> measurements(steps);
+        for (int step = 0; step < steps; step++)
+        {
+            const double t = step * dt;
+            measurements[step] = {
+                t + rng.gaussian(0.1), 2 * t + rng.gaussian(0.1), 3 * t + rng.gaussian(0.1),
+                1 + rng.gaussian(0.1), 2 + rng.gaussian(0.1), 3 + rng.gaussian(0.1)
+            };
+        }
+
+        const auto start = cv::getTickCount();
+        for (int step = 0; step < steps; step++)
+        {
+            reference.predict();
+            reference.correct(cv::Mat(measurements[step]));
+        }
+        const auto middle = cv::getTickCount();
+        for (int step = 0; step < steps; step++)
+        {
+            fixed.predict();
+            fixed.correct(measurements[step]);
+        }
+        const auto end = cv::getTickCount();
+
+        const double frequency = cv::getTickFrequency() / 1e9;
+        std::cout << steps << " steps: cv::KalmanFilter " << static_cast<double>(middle - start) / frequency / steps
+            << " ns, rm::kalman " << static_cast<double>(end - middle) / frequency / steps << " ns per step"
+            << std::endl;
+
+        if (const double difference = state_difference<double>(reference.statePost, fixed.state); difference > 1e-6)
+        {
+            std::cout << "benchmark states differ by " << difference << std::endl;
+            passed = false;
+        }
+    }
+
+    return passed ? 0 : 1;
 }
@@ -18,6 +18,29 @@ cv::Mat h_gripper2camera = (cv::Mat_<double>(4, 4) <<
     0.04561278583864914f, -0.9989127101040636f, -0.009636978810429797f, 77.11760876626687f,
     0.0f, 0.0f, 0.0f, 1.0f);
 
+// run a full-frame scan every N frames or when a track is unmatched, search around the tracked armours otherwise
+constexpr int full_scan_interval = 30;
+constexpr float search_window_scale = 2.0f;
+// horizontal stripes binarized (and contour chunks classified) in parallel, tune to the core count
+constexpr int extraction_stripes = 4;
+// detect light blobs on the raw Bayer frame at half resolution, demosaic only for icon crops
+constexpr bool bayer_domain = false;
+// at most this many armours go through classification and PnP per frame
+constexpr int armour_candidates_max = 6;
+// find candidates on a 2x downsampled frame and refine around them instead of scanning the full frame
+constexpr bool pyramid_detection = false;
+// also run the inactive full-scan mode on full-scan frames and report both modes side by side
+constexpr bool compare_detection_modes = true;
+// search guide lights in the upper half of the frame next to the armours
+constexpr bool guidelight_detection = true;
+// report the average time of each stage every N frames
+constexpr int timing_interval = 210;
+
+// competition thresholds, folded into the light blob and armour filters at compile time
+constexpr rm::detector_config detector_blue{
+    70, {1.5f, 80}, {10, 99999}, 12, 22, 0.4f, rm::CAMP_BLUE, true, armour_candidates_max
+};
+
 const cv::Ptr<cv::ml::SVM> svm_red = cv::ml::SVM::load("svm.xml");
 const cv::Ptr<cv::ml::SVM> svm_blue = cv::ml::SVM::load("svm.xml");
 
@@ -32,6 +55,8 @@ struct frame_package
     int64 timestamp;
     serial_package package;
     cv::Mat image;
+    cv::Mat raw;
+    rm::BayerPattern pattern;
 };
 
 void serial_function(rm::parallel_queue<serial_package>& serial_queue);
@@ -42,6 +67,9 @@ void process_function(rm::parallel_queue<frame_package>& frame_queue,
                       rm::parallel_queue<std::vector<rm::armour>>& armour_queue,
                       rm::parallel_queue<cv::Mat>& debug_queue);
 
+void extract_full_scan(const cv::Mat& image, bool pyramid, rm::adaptive_threshold& threshold,
+                       rm::preprocess_workspace& workspace, rm::debug::stage_timer& timer);
+
 int main()
 {
     rm::parallel_queue<serial_package> serial_queue;
@@ -56,32 +84,9 @@ int main()
 
     std::thread tracking_thread([&armour_queue]()
     {
-        std::vector<rm::armour> tracking;
         while (1)
         {
-            auto armours = armour_queue.pop();
-            if (armours->empty()) continue;
-
-            if (tracking.empty())
-            {
-                tracking = *armours;
-                continue;
-            }
-
-            for (int i{0}; i < tracking.size(); i++)
-            {
-                if (auto [index, IoU] = tracking[i].max_IoU(*armours);
-                    IoU > 0.5)
-                {
-                    tracking[i].update(armours->at(index));
-                    armours->erase(armours->begin() + index);
-                }
-                else if (tracking[i].lost_count++ > 25)
-                    tracking.erase(tracking.begin() + i);
-                else tracking[i].update(tracking[i].timestamp);
-            }
-
-            tracking.insert(tracking.end(), armours->begin(), armours->end());
+            const auto targets = armour_queue.pop();
 
             // decide which armour to shoot
         }
@@ -151,12 +156,34 @@ void frame_function(rm::parallel_queue<serial_package>& serial_queue, rm::parall
 
     while (status)
     {
-        cv::Mat image = camera.capture(true, true);
-        if (image.empty()) break;
+        cv::Mat image, raw;
+        int pattern = rm::BAYER_RG;
+        if (bayer_domain) std::tie(raw, pattern) = camera.capture_raw(true, true);
+        else image = camera.capture(true, true);
+        if (image.empty() && raw.empty()) break;
 
         if (!frame_queue.empty()) frame_queue.tryPop();
         auto package = serial_queue.pop();
-        frame_queue.push({cv::getTickCount(), *package, image});
+        frame_queue.push({cv::getTickCount(), *package, image, raw, static_cast<rm::BayerPattern>(pattern)});
+    }
+}
+
+/// Binarize a full-scan frame into the workspace, on the whole frame or around the candidates of a 2x downsampled
+/// frame when pyramid is set.
+void extract_full_scan(const cv::Mat& image, const bool pyramid, rm::adaptive_threshold& threshold,
+                       rm::preprocess_workspace& workspace, rm::debug::stage_timer& timer)
+{
+    if (pyramid)
+    {
+        const auto candidates =
+            rm::coarse_windows(image, detector_blue.enemy, threshold.value(), detector_blue.tilt_max,
+                               detector_blue.ratio_range, detector_blue.area_range);
+        timer.lap("coarse");
+        rm::binarize_color(image, rm::CAMP_BLUE, threshold, candidates, workspace);
+    }
+    else
+    {
+        rm::binarize_color(image, rm::CAMP_BLUE, threshold, workspace, extraction_stripes);
     }
 }
 
@@ -164,21 +191,85 @@ void process_function(rm::parallel_queue<frame_package>& frame_queue,
                       rm::parallel_queue<std::vector<rm::armour>>& armour_queue,
                       rm::parallel_queue<cv::Mat>& debug_queue)
 {
+    rm::preprocess_workspace workspace;
+    rm::adaptive_threshold threshold;
+    cv::Mat features, identities;
+    std::vector<cv::Rect> windows;
+    rm::tracker tracker;
+    int64 frame_count = 0;
+    rm::debug::stage_timer timer;
+    rm::preprocess_workspace comparison_workspace;
+    rm::debug::stage_timer full_frame_timer, pyramid_timer;
+    rm::lightblob_filter_stats filter_stats;
+    rm::preprocess_workspace guidelight_workspace;
+    rm::adaptive_threshold guidelight_threshold;
+    std::vector<rm::lightblob> guidelights;
     while (1)
     {
         const auto frame = frame_queue.pop();
         const auto h_base2gripper = rm::utils::homogeneous(frame->package.rotation.to_matrix());
+        timer.start();
 
-        auto [contours, binary] = extract_color(frame->image, rm::CAMP_BLUE, 80);
-        auto [positive, negtive] =
-            filter_lightblobs(contours, 70, {1.5, 80}, {10, 99999}, rm::CAMP_BLUE);
-        auto armours =
-            filter_armours(positive, 12, 22, 0.4, rm::CAMP_BLUE);
+        const cv::Size frame_size = bayer_domain ? frame->raw.size() : frame->image.size();
+
+        const bool full_scan = frame_count++ % full_scan_interval == 0 || windows.empty();
+        const rm::adaptive_threshold frame_threshold = threshold;
+        if (bayer_domain)
+        {
+            if (full_scan)
+            {
+                rm::binarize_bayer(frame->raw, frame->pattern, rm::CAMP_BLUE, threshold, workspace,
+                                   extraction_stripes);
+            }
+            else
+            {
+                rm::binarize_bayer(frame->raw, frame->pattern, rm::CAMP_BLUE, threshold, windows, workspace);
+            }
+        }
+        else if (full_scan)
+        {
+            extract_full_scan(frame->image, pyramid_detection, threshold, workspace, timer);
+        }
+        else
+        {
+            rm::binarize_color(frame->image, rm::CAMP_BLUE, threshold, windows, workspace);
+        }
 
-        for (auto& armour : armours)
+        // components are labelled instead of traced, so that extraction does not allocate in the steady state
+        rm::label_blobs(workspace.binary, workspace, extraction_stripes);
+        if (bayer_domain)
         {
-            cv::Mat icon = rm::affine_correction(frame->image, armour.icon, {20, 20});
-            armour.identity = static_cast<int>(svm_red->predict(rm::utils::flatten_image(icon, CV_32FC1)));
+            for (auto& blob : workspace.blobs) blob = blob.scaled(2);
+        }
+        timer.lap("extraction");
+
+        auto [positive, negtive] = rm::filter_lightblobs<detector_blue>(workspace.blobs, &filter_stats);
+        timer.lap("lightblobs");
+        auto armours = rm::filter_armours<detector_blue>(positive);
+        timer.lap("armours");
+
+        cv::Mat image = frame->image;
+        if (image.empty() && !armours.empty()) rm::demosaic(frame->raw, image, frame->pattern);
+
+        if (!armours.empty())
+        {
+            rm::rectify_icons(image, armours, features);
+            if (features.empty()) armours.clear();
+            else svm_red->predict(features, identities);
+        }
+        timer.lap("classification");
+
+        guidelights.clear();
+        if (guidelight_detection && !frame->image.empty())
+        {
+            guidelights = rm::find_guidelights(frame->image, guidelight_threshold, guidelight_workspace);
+            timer.lap("guidelight");
+        }
+
+        for (int i = 0; i < armours.size(); i++)
+        {
+            auto& armour = armours[i];
+            armour.identity = static_cast<int>(identities.at<float>(i));
 
             auto [rvec, tvec] =
                 rm::solve_PnP(armour.vertices, cammat, discof, {27, 27});
@@ -192,16 +283,77 @@ void process_function(rm::parallel_queue<frame_package>& frame_queue,
                                           world_position.at<double>(2, 0));
 
             armour.timestamp = frame->timestamp;
-            armour.reset(5e-5, 0.5, 0.05);
         }
+        timer.lap("pnp");
+
+        if (timer.count() >= timing_interval)
+        {
+            std::cout << (pyramid_detection ? "pyramid " : "full-frame ") << timer.report() << std::endl;
+            std::cout << "components " << filter_stats.contours << ", area " << filter_stats.area
+                      << ", ellipse " << filter_stats.ellipse << ", accepted " << filter_stats.accepted << std::endl;
+            timer.reset();
+            filter_stats = {};
+
+            if (full_frame_timer.count() > 0)
+            {
+                std::cout << full_frame_timer.count() << " full-scan frames, full-frame " << full_frame_timer.report()
+                          << " | pyramid " << pyramid_timer.report() << std::endl;
+                full_frame_timer.reset();
+                pyramid_timer.reset();
+            }
+        }
+
+        tracker.update(armours);
+        timer.lap("tracking");
+
+        // both full-scan modes again on the same frame, each from the threshold the active mode started with, after the
+        // last lap so that the active timings are not affected
+        if (compare_detection_modes && full_scan && !bayer_domain)
+        {
+            for (const bool pyramid : {false, true})
+            {
+                rm::debug::stage_timer& mode_timer = pyramid ? pyramid_timer : full_frame_timer;
+                rm::adaptive_threshold mode_threshold = frame_threshold;
+
+                mode_timer.start();
+                extract_full_scan(frame->image, pyramid, mode_threshold, comparison_workspace, mode_timer);
+                rm::label_blobs(comparison_workspace.binary, comparison_workspace, extraction_stripes);
+                mode_timer.lap("extraction");
+                const auto mode_blobs = std::get<0>(rm::filter_lightblobs<detector_blue>(comparison_workspace.blobs));
+                mode_timer.lap("lightblobs");
+                rm::filter_armours<detector_blue>(mode_blobs);
+                mode_timer.lap("armours");
+            }
+        }
+
+        // search windows of the next frame around the tracked armours, an unmatched track falls back to full-frame
+        // scan so that a target leaving its window is found again
+        windows.clear();
+        const auto& targets = tracker.targets();
+        if (std::none_of(targets.begin(), targets.end(),
+                         [](const rm::armour& target) { return target.lost_count > 0; }))
+        {
+            for (auto& target : targets)
+                windows.push_back(rm::utils::GetROI(target.icon, 4, search_window_scale, frame_size));
+        }
+
         if (!armour_queue.empty()) armour_queue.tryPop();
-        armour_queue.push(armours);
+        armour_queue.push(targets);
 
         cv::Mat debug;
-        binary.copyTo(debug);
+        resize(workspace.binary, debug, frame_size, 0, 0, cv::INTER_NEAREST);
         cvtColor(debug, debug, cv::COLOR_GRAY2BGR);
         rm::debug::draw_lightblobs(positive, negtive, debug, -1);
         rm::debug::draw_armours(armours, debug, -1);
+        for (auto& guidelight : guidelights)
+            circle(debug, guidelight.center, static_cast<int>(guidelight.size.height / 2), {0, 255, 0}, 2);
+        putText(debug, "threshold: " + std::to_string(threshold.value()), {10, 30}, cv::FONT_HERSHEY_SIMPLEX, 0.8,
+                {0, 255, 255});
+        if (guidelight_detection)
+        {
+            putText(debug, "guidelight threshold: " + std::to_string(guidelight_threshold.value()), {10, 60},
+                    cv::FONT_HERSHEY_SIMPLEX, 0.8, {0, 255, 0});
+        }
 
         if (!debug_queue.empty()) debug_queue.tryPop();
         debug_queue.push(debug);
@@ -0,0 +1,237 @@
+//
+// Created by yaione on 10/18/26.
+//
+
+#include "rmcv.h"
+
+/// Pairs accepted by the original quadratic filter_armours, as (lower, higher) source indices.
+std::vector<std::pair<int, int>> quadratic_pairs(const std::vector<rm::lightblob>& lightblobs,
+                                                 const float angle_difference_max, const float shear_max,
+                                                 const float lenght_ratio_max, const rm::camp enemy)
+{
+    std::vector<std::pair<int, int>> pairs;
+    for (int i = 0; i + 1 < static_cast<int>(lightblobs.size()); ++i)
+    {
+        if (lightblobs[i].target != enemy)
+            continue;
+        for (int j = i + 1; j < static_cast<int>(lightblobs.size()); ++j)
+        {
+            if (lightblobs[j].target != enemy)
+                continue;
+
+            if (const float angle_difference = std::abs(lightblobs[i].angle - lightblobs[j].angle);
+                angle_difference > angle_difference_max)
+                continue;
+
+            const float y = std::abs(lightblobs[i].center.y - lightblobs[j].center.y);
+            const float x = std::abs(lightblobs[i].center.x - lightblobs[j].center.x);
+            const float rect_angle = atan2(y, x) * 180.0f / static_cast<float>(CV_PI);
+            const float shear_i = std::abs(lightblobs[i].angle > 90
+                                               ? std::abs(lightblobs[i].angle - rect_angle) - 90
+                                               : std::abs(180 - lightblobs[i].angle - rect_angle) - 90);
+            const float shear_j = std::abs(lightblobs[j].angle > 90
+                                               ? std::abs(lightblobs[j].angle - rect_angle) - 90
+                                               : std::abs(180 - lightblobs[j].angle - rect_angle) - 90);
+            if (shear_i > shear_max || shear_j > shear_max)
+                continue;
+
+            const float height_i = lightblobs[i].size.height;
+            const float height_j = lightblobs[j].size.height;
+            if (const float ratio = std::min(height_i, height_j) / std::max(height_i, height_j);
+                ratio < lenght_ratio_max)
+                continue;
+
+            if (y > (height_i + height_j) / 2)
+                continue;
+
+            if (x > (height_i + height_j) * 2)
+                continue;
+
+            pairs.emplace_back(i, j);
+        }
+    }
+    return pairs;
+}
+
+/// Random light blobs of both camps spread over a frame.
+std::vector<rm::lightblob> random_lightblobs(cv::RNG& rng, const int count)
+{
+    std::vector<rm::lightblob> lightblobs;
+    for (int i = 0; i < count; i++)
+    {
+        const cv::Point2f center(rng.uniform(0.0f, 1280.0f), rng.uniform(0.0f, 1024.0f));
+        const cv::Size2f size(rng.uniform(3.0f, 12.0f), rng.uniform(10.0f, 80.0f));
+        lightblobs.emplace_back(cv::RotatedRect(center, size, rng.uniform(-25.0f, 25.0f)),
+                                rng.uniform(0, 4) == 0 ? rm::CAMP_RED : rm::CAMP_BLUE);
+    }
+    return lightblobs;
+}
+
+/// Compile time configuration with the limits of the runtime calls it is benchmarked against.
+constexpr rm::detector_config benchmark_config{70, {1.5f, 80}, {10, 99999}, 12, 22, 0.4f, rm::CAMP_BLUE, true, 0};
+
+int main()
+{
+    bool passed = true;
+
+    // coarse pass: a far armour with 2x6 px light bars is 1x3 px at half resolution and must still get windows
+    {
+        cv::Mat image = cv::Mat::zeros(1024, 1280, CV_8UC3);
+        const cv::Rect bars[] = {{400, 500, 2, 6}, {414, 500, 2, 6}, {800, 400, 8, 40}, {860, 400, 8, 40}};
+        for (const auto& bar : bars) rectangle(image, bar, {255, 80, 40}, cv::FILLED);
+
+        const auto windows = rm::coarse_windows(image, rm::CAMP_BLUE, 80, 70, {1.5f, 80}, {10, 99999});
+        for (const auto& bar : bars)
+        {
+            if (std::none_of(windows.begin(), windows.end(), [&bar](const cv::Rect& window)
+            {
+                return (window & bar) == bar;
+            }))
+            {
+                std::cout << "no coarse window around the light bar " << bar << std::endl;
+                passed = false;
+            }
+        }
+    }
+    std::cout << (passed ? "coarse windows passed" : "coarse windows failed") << std::endl;
+
+    // sweep line pairing: the same pairs as the quadratic loop it replaced, on sets of growing size
+    bool paired = true;
+    cv::RNG rng(0x5eed);
+    for (int count = 8; count <= 2048; count *= 2)
+    {
+        const auto lightblobs = random_lightblobs(rng, count);
+
+        const auto start = cv::getTickCount();
+        const auto expected = quadratic_pairs(lightblobs, 12, 22, 0.4f, rm::CAMP_BLUE);
+        const auto middle = cv::getTickCount();
+        const auto pairs = rm::pair_lightblobs(rm::lightblob_set(lightblobs, rm::CAMP_BLUE), 12, 22, 0.4f, false);
+        const auto end = cv::getTickCount();
+
+        bool same = pairs.size() == expected.size();
+        for (size_t i = 0; same && i < pairs.size(); i++)
+            same = pairs[i].first == expected[i].first && pairs[i].second == expected[i].second;
+        if (!same)
+        {
+            std::cout << count << " light blobs: " << pairs.size() << " pairs, " << expected.size() << " expected"
+                << std::endl;
+            paired = false;
+        }
+
+        const double frequency = cv::getTickFrequency() / 1e6;
+        std::cout << count << " light blobs, " << expected.size() << " pairs: quadratic "
+            << static_cast<double>(middle - start) / frequency << " us, sweep line "
+            << static_cast<double>(end - middle) / frequency << " us" << std::endl;
+    }
+    std::cout << (paired ? "sweep line passed" : "sweep line failed") << std::endl;
+    passed = passed && paired;
+
+    // coincident centres have a rectangle angle of 0 like atan2(0, 0), only light blobs within the shear limit of a
+    // horizontal pair are paired
+    {
+        bool coincident = true;
+        for (const float tilt : {0.0f, 5.0f, 20.0f, 30.0f, 35.0f})
+        {
+            const std::vector<rm::lightblob> lightblobs = {
+                rm::lightblob({{600, 500}, {8, 40}, tilt}, rm::CAMP_BLUE),
+                rm::lightblob({{600, 500}, {8, 40}, tilt + 5}, rm::CAMP_BLUE)
+            };
+            const auto expected = quadratic_pairs(lightblobs, 12, 22, 0.4f, rm::CAMP_BLUE);
+            const auto pairs = rm::pair_lightblobs(rm::lightblob_set(lightblobs, rm::CAMP_BLUE), 12, 22, 0.4f, false);
+            if (pairs.size() != expected.size())
+            {
+                std::cout << "coincident centres, tilt " << tilt << ": " << pairs.size() << " pairs, "
+                    << expected.size() << " expected" << std::endl;
+                coincident = false;
+            }
+        }
+        std::cout << (coincident ? "coincident centres passed" : "coincident centres failed") << std::endl;
+        passed = passed && coincident;
+    }
+
+    // zero angle and shear limits only admit ideal pairs, which must still get a finite score
+    {
+        std::vector<rm::lightblob> lightblobs = {
+            rm::lightblob({{600, 500}, {8, 40}, 0}, rm::CAMP_BLUE),
+            rm::lightblob({{660, 500}, {8, 40}, 0}, rm::CAMP_BLUE)
+        };
+        const auto armours = rm::filter_armours(lightblobs, 0, 0, 0.4f, rm::CAMP_BLUE);
+        if (armours.size() != 1 || !std::isfinite(armours.front().score))
+        {
+            std::cout << "zero limits: " << armours.size() << " armours" << std::endl;
+            passed = false;
+        }
+    }
+
+    // guide lights keep their own threshold, updated from the green minus red plane of the band only
+    {
+        cv::Mat image(1024, 1280, CV_8UC3, cv::Scalar(200, 40, 40));
+        circle(image, {640, 200}, 20, {60, 255, 60}, cv::FILLED);
+        rm::adaptive_threshold threshold;
+        rm::preprocess_workspace workspace;
+
+        bool found = true;
+        for (int frame = 0; frame < 10; frame++)
+            found = found && rm::find_guidelights(image, threshold, workspace).size() == 1;
+        if (!found)
+        {
+            std::cout << "guide light lost with the threshold at " << threshold.value() << std::endl;
+            passed = false;
+        }
+    }
+
+    // compile time configuration: the same light blobs and armours as the runtime functions, timed over repeated runs
+    {
+        constexpr int runs = 100;
+        const double frequency = cv::getTickFrequency() / 1e6;
+        bool same = true;
+
+        cv::Mat image = cv::Mat::zeros(1024, 1280, CV_8UC1);
+        for (const auto& lightblob : random_lightblobs(rng, 256))
+            ellipse(image, cv::RotatedRect(lightblob.center, lightblob.size, lightblob.angle - 90), 255, cv::FILLED);
+        std::vector<rm::contour> contours;
+        findContours(image, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+
+        std::vector<rm::lightblob> runtime_blobs, constant_blobs;
+        auto start = cv::getTickCount();
+        for (int run = 0; run < runs; run++)
+            runtime_blobs = std::get<0>(rm::filter_lightblobs(contours, 70, {1.5f, 80}, {10, 99999}, rm::CAMP_BLUE));
+        auto middle = cv::getTickCount();
+        for (int run = 0; run < runs; run++)
+            constant_blobs = std::get<0>(rm::filter_lightblobs<benchmark_config>(contours));
+        auto end = cv::getTickCount();
+
+        same = runtime_blobs.size() == constant_blobs.size();
+        for (size_t i = 0; same && i < runtime_blobs.size(); i++)
+            same = runtime_blobs[i].center == constant_blobs[i].center;
+        std::cout << contours.size() << " contours, " << runtime_blobs.size() << " light blobs: runtime "
+            << static_cast<double>(middle - start) / frequency / runs << " us, constexpr "
+            << static_cast<double>(end - middle) / frequency / runs << " us" << std::endl;
+
+        for (int count = 64; count <= 2048; count *= 4)
+        {
+            auto lightblobs = random_lightblobs(rng, count);
+
+            std::vector<rm::armour> runtime_armours, constant_armours;
+            start = cv::getTickCount();
+            for (int run = 0; run < runs; run++)
+                runtime_armours = rm::filter_armours(lightblobs, 12, 22, 0.4f, rm::CAMP_BLUE, true, 0);
+            middle = cv::getTickCount();
+            for (int run = 0; run < runs; run++)
+                constant_armours = rm::filter_armours<benchmark_config>(lightblobs);
+            end = cv::getTickCount();
+
+            if (runtime_armours.size() != constant_armours.size()) same = false;
+            for (size_t i = 0; same && i < runtime_armours.size(); i++)
+                same = runtime_armours[i].score == constant_armours[i].score;
+            std::cout << count << " light blobs, " << runtime_armours.size() << " armours: runtime "
+                << static_cast<double>(middle - start) / frequency / runs << " us, constexpr "
+                << static_cast<double>(end - middle) / frequency / runs << " us" << std::endl;
+        }
+
+        std::cout << (same ? "compile time configuration passed" : "compile time configuration failed") << std::endl;
+        passed = passed && same;
+    }
+
+    return passed ? 0 : 1;
+}
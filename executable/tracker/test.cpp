@@ -0,0 +1,207 @@
+//
+// Created by yaione on 10/18/26.
+//
+
+#include "rmcv.h"
+
+/// Armours of a grid of targets moving right, target i keeps identity i.
+std::vector<rm::armour> synthetic_frame(const int targets, const int frame)
+{
+    std::vector<rm::armour> armours;
+    for (int i = 0; i < targets; i++)
+    {
+        const cv::Point2f center(100.0f + static_cast<float>(i % 8) * 140 + static_cast<float>(frame) * 2,
+                                 100.0f + static_cast<float>(i / 8) * 200);
+        const rm::lightblob left({center - cv::Point2f(30, 0), {6, 30}, 0}, rm::CAMP_BLUE);
+        const rm::lightblob right({center + cv::Point2f(30, 0), {6, 30}, 0}, rm::CAMP_BLUE);
+
+        rm::armour armour(rm::armour_candidate(left, right));
+        armour.position = {center.x, center.y, 3000};
+        armour.timestamp = static_cast<int64>(frame + 1) * static_cast<int64>(cv::getTickFrequency() / 200);
+        armour.identity = i;
+        armours.push_back(armour);
+    }
+
+    // detections arrive in a different order every frame
+    std::rotate(armours.begin(), armours.begin() + frame % std::max(targets, 1), armours.end());
+    return armours;
+}
+
+int main()
+{
+    // deterministic assignment: every track keeps its target through 100 frames
+    bool passed = true;
+    {
+        rm::tracker tracker;
+        for (int frame = 0; frame < 100; frame++)
+        {
+            tracker.update(synthetic_frame(32, frame));
+
+            const auto& tracks = tracker.targets();
+            if (tracks.size() != 32)
+            {
+                std::cout << "frame " << frame << ": " << tracks.size() << " tracks" << std::endl;
+                passed = false;
+                break;
+            }
+            for (int i = 0; i < tracks.size(); i++)
+            {
+                const int expected = frame == 0 ? tracks[i].identity : i;
+                if (tracks[i].identity != expected || tracks[i].lost_count != 0)
+                {
+                    std::cout << "frame " << frame << ": track " << i << " matched target " << tracks[i].identity
+                        << std::endl;
+                    passed = false;
+                }
+            }
+            // new tracks start at their first measurement
+            for (int i = 0; passed && frame == 0 && i < tracks.size(); i++)
+            {
+                if (const cv::Point3d position = tracker.states().position(i); position != tracks[i].position)
+                {
+                    std::cout << "track " << i << ": starts at " << position << " instead of " << tracks[i].position
+                        << std::endl;
+                    passed = false;
+                }
+            }
+            if (!passed) break;
+        }
+
+        // the filters follow the 2 px per frame motion at 200 fps
+        for (int i = 0; passed && i < tracker.states().size(); i++)
+        {
+            const cv::Point3d position = tracker.states().position(i), velocity = tracker.states().velocity(i);
+            if (norm(position - tracker.targets()[i].position) > 2)
+            {
+                std::cout << "track " << i << ": position " << position << " measured at "
+                    << tracker.targets()[i].position << std::endl;
+                passed = false;
+            }
+            if (std::abs(velocity.x - 400) > 20 || std::abs(velocity.y) > 20)
+            {
+                std::cout << "track " << i << ": velocity " << velocity << std::endl;
+                passed = false;
+            }
+        }
+
+        // tracks are dropped after lost_max frames without detections
+        for (int frame = 0; frame <= 26; frame++) tracker.update({});
+        if (!tracker.targets().empty())
+        {
+            std::cout << tracker.targets().size() << " tracks left after losing all targets" << std::endl;
+            passed = false;
+        }
+    }
+    std::cout << (passed ? "assignment passed" : "assignment failed") << std::endl;
+
+    // vectorised subset correction: every axis of every track follows a 2 state rm::kalman fed the same measurements,
+    // track counts not a multiple of the SIMD width exercise the scalar tail
+    {
+        constexpr int tracks = 13;
+        constexpr double q = 5e-5, r = 0.5, error = 0.05;
+        const auto tick = static_cast<int64>(cv::getTickFrequency() / 100);
+
+        rm::track_bank bank(tracks, q, r, error);
+        std::vector<std::array<rm::kalman<2, 2>, 3>> filters(tracks);
+        std::vector<cv::Point3d> last(tracks);
+        std::vector<int64> last_at(tracks);
+        cv::RNG rng(0x5eed);
+
+        for (int i = 0; i < tracks; i++)
+        {
+            last[i] = {rng.uniform(0.0, 1000.0), rng.uniform(0.0, 1000.0), rng.uniform(1000.0, 5000.0)};
+            bank.add(last[i], 0);
+            for (int a = 0; a < 3; a++)
+            {
+                // the bank starts at the first measurement with the measurement noise and a zero velocity
+                auto& filter = filters[i][a];
+                const double value = a == 0 ? last[i].x : a == 1 ? last[i].y : last[i].z;
+                filter = rm::kalman<2, 2>(q, r, error);
+                filter.state = rm::kalman<2, 2>::state_vector(value, 0);
+                filter.covariance(0, 0) = r;
+            }
+        }
+
+        double difference_max = 0;
+        std::vector<int> indices;
+        std::vector<cv::Point3d> positions;
+        std::vector<int64> timestamps;
+        for (int step = 1; step <= 50; step++)
+        {
+            bank.predict_all(0.01);
+            for (auto& axes : filters)
+            {
+                for (auto& filter : axes)
+                {
+                    filter.transition(0, 1) = 0.01;
+                    filter.predict();
+                }
+            }
+
+            indices.clear();
+            positions.clear();
+            timestamps.clear();
+            for (int i = 0; i < tracks; i++)
+            {
+                if (rng.uniform(0, 3) == 0) continue;
+
+                const cv::Point3d position = last[i] + cv::Point3d(rng.gaussian(2), rng.gaussian(2), rng.gaussian(5));
+                const double dt = static_cast<double>(step * tick - last_at[i]) / cv::getTickFrequency();
+                for (int a = 0; a < 3; a++)
+                {
+                    const double value = a == 0 ? position.x : a == 1 ? position.y : position.z;
+                    const double previous = a == 0 ? last[i].x : a == 1 ? last[i].y : last[i].z;
+                    filters[i][a].correct(rm::kalman<2, 2>::measurement_vector(value, (value - previous) / dt));
+                }
+
+                indices.push_back(i);
+                positions.push_back(position);
+                timestamps.push_back(step * tick);
+                last[i] = position;
+                last_at[i] = step * tick;
+            }
+            bank.correct_subset(indices.data(), positions.data(), timestamps.data(), static_cast<int>(indices.size()));
+
+            for (int i = 0; i < tracks; i++)
+            {
+                const cv::Point3d position = bank.position(i), velocity = bank.velocity(i);
+                const double states[3][2] = {
+                    {position.x, velocity.x}, {position.y, velocity.y}, {position.z, velocity.z}
+                };
+                for (int a = 0; a < 3; a++)
+                {
+                    for (int s = 0; s < 2; s++)
+                    {
+                        const double expected = filters[i][a].state(s);
+                        difference_max = std::max(difference_max,
+                                                  std::abs(states[a][s] - expected) / (1 + std::abs(expected)));
+                    }
+                }
+            }
+        }
+
+        if (difference_max > 1e-9)
+        {
+            std::cout << "track bank deviates from rm::kalman by " << difference_max << std::endl;
+            passed = false;
+        }
+        std::cout << (difference_max <= 1e-9 ? "subset correction passed" : "subset correction failed") << std::endl;
+    }
+
+    // update time against the number of tracks and detections
+    for (int targets = 1; targets <= 32; targets *= 2)
+    {
+        std::vector<std::vector<rm::armour>> frames;
+        for (int frame = 0; frame < 1000; frame++) frames.push_back(synthetic_frame(targets, frame));
+
+        rm::tracker tracker;
+        const auto start = cv::getTickCount();
+        for (auto& frame : frames) tracker.update(frame);
+        const double elapsed = static_cast<double>(cv::getTickCount() - start) / cv::getTickFrequency();
+
+        std::cout << targets << " x " << targets << ": " << elapsed / static_cast<double>(frames.size()) * 1e6
+            << " us per update" << std::endl;
+    }
+
+    return passed ? 0 : 1;
+}
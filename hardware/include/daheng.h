@@ -44,6 +44,13 @@ namespace rm::hardware
         ~daheng();
 
         cv::Mat capture(bool flip = false, bool mirror = false);
+
+        /// Capture a raw 8 bit Bayer frame without demosaicing. 10 and 12 bit formats are packed to 8 bit.
+        /// \param flip   Flip the frame vertically.
+        /// \param mirror Mirror the frame horizontally.
+        /// \return Raw frame (CV_8UC1, empty on failure or with mono sensors) and its color filter
+        ///         (DX_PIXEL_COLOR_FILTER) after flipping and mirroring.
+        std::tuple<cv::Mat, int> capture_raw(bool flip = false, bool mirror = false);
     };
 }
 
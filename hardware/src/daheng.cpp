@@ -88,6 +88,62 @@ namespace rm::hardware
         return {};
     }
 
+    std::tuple<cv::Mat, int> daheng::capture_raw(const bool flip, const bool mirror)
+    {
+        if (GXGetImage(hDevice, &frameData, 100) != GX_STATUS_SUCCESS || frameData.nStatus != 0) return {};
+
+        const int width = frameData.nWidth, height = frameData.nHeight;
+        void* raw = frameData.pImgBuf;
+        switch (PixelFormat)
+        {
+        case GX_PIXEL_FORMAT_BAYER_GR12:
+        case GX_PIXEL_FORMAT_BAYER_RG12:
+        case GX_PIXEL_FORMAT_BAYER_GB12:
+        case GX_PIXEL_FORMAT_BAYER_BG12:
+            DxRaw16toRaw8(raw, pRaw8Buffer, width, height, DX_BIT_4_11);
+            raw = pRaw8Buffer;
+            break;
+
+        case GX_PIXEL_FORMAT_BAYER_GR10:
+        case GX_PIXEL_FORMAT_BAYER_RG10:
+        case GX_PIXEL_FORMAT_BAYER_GB10:
+        case GX_PIXEL_FORMAT_BAYER_BG10:
+            DxRaw16toRaw8(raw, pRaw8Buffer, width, height, DX_BIT_2_9);
+            raw = pRaw8Buffer;
+            break;
+
+        case GX_PIXEL_FORMAT_BAYER_GR8:
+        case GX_PIXEL_FORMAT_BAYER_RG8:
+        case GX_PIXEL_FORMAT_BAYER_GB8:
+        case GX_PIXEL_FORMAT_BAYER_BG8:
+            break;
+
+        default:
+            return {};
+        }
+
+        // same color filter as capture(), mirroring swaps the columns of the 2x2 cell
+        int filter = mirror ? BAYERGB : BAYERBG;
+        if (mirror)
+        {
+            DxImageMirror(raw, pMirrorBuffer, width, height, HORIZONTAL_MIRROR);
+            raw = pMirrorBuffer;
+        }
+
+        cv::Mat frame(cv::Size(width, height), CV_8UC1, raw);
+        if (flip)
+        {
+            // flipping swaps the rows of the 2x2 cell
+            cv::Mat flipped(cv::Size(width, height), CV_8UC1, pRGBframeData);
+            cv::flip(frame, flipped, 0);
+            frame = flipped;
+            filter = mirror ? BAYERRG : BAYERGR;
+        }
+
+        fps++;
+        return {frame, filter};
+    }
+
     void daheng::ProcessData(void* pImageBuf, void* pImageRaw8Buf, void* pImageRGBBuf, const int nImageWidth,
                                    const int nImageHeight,
                                    const int nPixelFormat, int nPixelColorFilter, const bool flip,
@@ -6,6 +6,7 @@
 #define RMCV_CORE_H
 
 #include <cmath>
+#include <array>
 #include <vector>
 #include <string>
 #include <filesystem>
@@ -27,17 +28,23 @@ namespace rm
         RECT_TALL = 0, RECT_SIDE = 1
     };
 
+    /// Color filter arrangement of the top-left 2x2 cell of a raw frame (same values as DX_PIXEL_COLOR_FILTER).
+    enum BayerPattern
+    {
+        BAYER_RG = 1, BAYER_GB = 2, BAYER_GR = 3, BAYER_BG = 4
+    };
+
     template <typename T>
     struct range
     {
         T lower_bound;
         T upper_bound;
 
-        range(T lower, T upper) : lower_bound(lower), upper_bound(upper)
+        constexpr range(T lower, T upper) : lower_bound(lower), upper_bound(upper)
         {
         }
 
-        [[nodiscard]] bool contains(T value) const
+        [[nodiscard]] constexpr bool contains(T value) const
         {
             return value >= lower_bound && value <= upper_bound;
         }
@@ -86,6 +93,29 @@ namespace rm
 
     typedef std::vector<cv::Point> contour;
 
+    /// Statistics of a connected component, accumulated without tracing its outline.
+    struct blob_stats
+    {
+        int area = 0; /// Pixel count of the component
+        cv::Rect bounding_box; /// Bounding box of the component
+        double sum_x = 0, sum_y = 0; /// First order raw moments
+        double sum_xx = 0, sum_xy = 0, sum_yy = 0; /// Second order raw moments
+
+        /// Accumulate another component (or part of it) into this one.
+        void merge(const blob_stats& other);
+
+        /// Statistics of the component upsampled by pixel replication, every pixel becoming a factor x factor block,
+        /// e.g. to bring a component labelled on a half resolution Bayer mask back to the raw frame.
+        [[nodiscard]] blob_stats scaled(int factor) const;
+
+        /// Mass center of the component.
+        [[nodiscard]] cv::Point2f center() const;
+
+        /// Ellipse with the same second order central moments as the component, computed in closed form. Follows
+        /// the cv::fitEllipse convention: width is the minor axis and the angle is the rotation of the width axis.
+        [[nodiscard]] cv::RotatedRect ellipse() const;
+    };
+
     class lightblob
     {
     public:
@@ -98,13 +128,84 @@ namespace rm
         explicit lightblob(cv::RotatedRect box, rm::camp camp = rm::CAMP_NEUTRAL);
     };
 
-    class armour
+    /// Structure of arrays store of light blobs of one camp, sorted ascending by center x for vectorised pairing.
+    class lightblob_set
+    {
+    public:
+        std::vector<float> cx; /// Center x of each light blob
+        std::vector<float> cy; /// Center y of each light blob
+        std::vector<float> angle; /// Rotation angle of each light blob (vertical when the angle is 90)
+        std::vector<float> height; /// Length of each light blob
+        std::vector<float> width; /// Thickness of each light blob
+        std::vector<float> top; /// Highest vertex y of each light blob
+        std::vector<float> bottom; /// Lowest vertex y of each light blob
+        std::vector<camp> target; /// Camp of each light blob
+        std::vector<int> index; /// Index of each light blob in the source vector
+
+        lightblob_set() = default;
+
+        /// Gather the light blobs of one camp.
+        /// \param lightblobs Source light blobs.
+        /// \param camp       Camp to keep.
+        lightblob_set(const std::vector<lightblob>& lightblobs, camp camp);
+
+        /// Replace the content with the light blobs of one camp, sorted ascending by center x (stable).
+        /// \param lightblobs Source light blobs.
+        /// \param camp       Camp to keep.
+        void assign(const std::vector<lightblob>& lightblobs, camp camp);
+
+        void clear();
+
+        [[nodiscard]] int size() const { return static_cast<int>(index.size()); }
+    };
+
+    /// Pair of light blobs forming an armour, ordered left to right. Holds references only, so it is free to build for
+    /// every pair and must not outlive the light blobs.
+    struct armour_candidate
+    {
+        const lightblob* left; /// Light blob with the smaller center x
+        const lightblob* right; /// Light blob with the larger center x
+        float score; /// Geometric score of the pair, higher is better
+
+        armour_candidate(const lightblob& first, const lightblob& second, float score = 0) :
+            left(second.center.x < first.center.x ? &second : &first),
+            right(second.center.x < first.center.x ? &first : &second), score(score)
+        {
+        }
+    };
+
+    /// Identity votes of a track over the SVM label set, decayed on every vote so that old observations fade and the
+    /// histogram stays bounded however long the track lives.
+    class identity_histogram
     {
-        std::map<int, int> identity_history = {};
+    public:
+        static constexpr int labels = 7; /// SVM labels: 1, 2, 3, 4, 5, sentry, negative
+
+    private:
+        std::array<float, labels> votes{};
+        float factor;
+
+    public:
+        /// \param decay Factor applied to all votes every frame, votes are bounded by 1 / (1 - decay).
+        explicit identity_histogram(float decay = 0.95f);
+
+        /// Decay all votes, called once per frame whether the identity is observed or not.
+        void decay();
+
+        /// Add one vote for the identity, identities outside the label set are ignored.
+        void vote(int identity);
+
+        /// Identity with the most votes and its softmax confidence over the identities voted for, computed in log
+        /// space. A single identity has confidence 1.
+        /// \return Identity and confidence, -1 when there is no vote.
+        [[nodiscard]] std::tuple<int, double> max() const;
 
-        cv::KalmanFilter observer;
-        cv::Mat measurement = cv::Mat::zeros(6, 1, CV_32F);
-        bool initialized = false;
+        void clear() { votes.fill(0); }
+    };
+
+    class armour
+    {
+        identity_histogram identity_history;
 
     public:
         cv::Point2f icon[4]; /// Vertices of icon area
@@ -115,18 +216,22 @@ namespace rm
         int lost_count = 0;
         cv::Point3d position;
         int identity = -1;
+        float score = 0; /// Geometric score of the light blob pair, higher is better
 
         explicit armour(std::vector<lightblob> lightblobs);
 
-        void reset(double process_noise, double measurement_noise, double error);
+        /// Build the armour geometry from a candidate without allocating.
+        explicit armour(const armour_candidate& candidate);
 
-        void update(const armour& new_observation);
+        /// Add an identity vote, the filtered state of a track is kept by rm::tracker.
+        void vote(int identity) { identity_history.vote(identity); }
 
-        void update(int64 new_timestamp);
+        /// Decay the identity votes, once per frame the armour is tracked.
+        void decay_votes() { identity_history.decay(); }
 
         [[nodiscard]] std::tuple<int, double> identity_max() const;
 
-        [[nodiscard]] std::tuple<int, float> max_IoU(std::vector<armour> armours) const;
+        [[nodiscard]] std::tuple<int, float> max_IoU(const std::vector<armour>& armours) const;
     };
 }
 
@@ -28,10 +28,38 @@ namespace rm::debug
         void write(const cv::Mat& image, const cv::Mat& data);
     };
 
+    /// Accumulate the time spent in named stages over frames and report the average per frame.
+    class stage_timer
+    {
+        std::vector<std::string> names;
+        std::vector<int64> ticks;
+        int64 last = 0;
+        int64 frames = 0;
+
+    public:
+        /// Start timing a new frame.
+        void start();
+
+        /// Add the time elapsed since the previous lap (or start) to the given stage.
+        void lap(const std::string& name);
+
+        /// Number of frames timed since the last reset.
+        [[nodiscard]] int64 count() const;
+
+        /// Average time per frame of each stage, in milliseconds.
+        [[nodiscard]] std::string report() const;
+
+        void reset();
+    };
+
     void draw_armours(const std::vector<armour>& input, cv::Mat& output, int index);
 
     void draw_lightblobs(const std::vector<lightblob>& positive, const std::vector<contour>& negative, cv::Mat& output,
                          int index);
+
+    /// Draw light blobs found on labelled components, negative components are drawn as their bounding boxes.
+    void draw_lightblobs(const std::vector<lightblob>& positive, const std::vector<blob_stats>& negative,
+                         cv::Mat& output, int index);
 }
 
 #endif //RMCV_DEBUG_H
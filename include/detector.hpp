@@ -0,0 +1,307 @@
+//
+// Created by yaione on 10/18/26.
+//
+
+#ifndef RMCV_DETECTOR_HPP
+#define RMCV_DETECTOR_HPP
+
+#include <optional>
+
+#include "objdetect.h"
+
+namespace rm
+{
+    /// Thresholds of filter_lightblobs and filter_armours. A constexpr instance with static storage can be passed as a
+    /// template parameter, so that fixed configurations get their limits and derived constants folded at compile time.
+    struct detector_config
+    {
+        float tilt_max; /// Maximal tilt angle of a light blob
+        range<float> ratio_range; /// Aspect ratio range of a light blob
+        range<double> area_range; /// Area range of a light blob
+        float angle_difference_max; /// Maximal angle difference between two light blobs
+        float shear_max; /// Maximal shear between two light blobs with the rectangle
+        float lenght_ratio_max; /// Maximal length ratio between two light blobs
+        camp enemy; /// Enemy camp
+        bool reject_overlap = true; /// Reject pairs bridging across a third light blob
+        int top_k = 0; /// Maximal number of armours, unlimited when not positive
+    };
+
+    /// Limits of a compile time detector_config as static constants, read through an instance like a detector_config.
+    template <const detector_config& C>
+    struct constant_config
+    {
+        static constexpr float tilt_max = C.tilt_max;
+        static constexpr range<float> ratio_range = C.ratio_range;
+        static constexpr range<double> area_range = C.area_range;
+        static constexpr float angle_difference_max = C.angle_difference_max;
+        static constexpr float shear_max = C.shear_max;
+        static constexpr float lenght_ratio_max = C.lenght_ratio_max;
+        static constexpr camp enemy = C.enemy;
+        static constexpr bool reject_overlap = C.reject_overlap;
+        static constexpr int top_k = C.top_k;
+    };
+
+    /// Implementations shared by the runtime functions in objdetect.h, which pass a detector_config, and the compile
+    /// time ones below, which pass a constant_config so that every test on a limit is folded.
+    namespace detail
+    {
+        /// Test the aspect ratio, without division, and the tilt of a light blob ellipse.
+        template <typename Config>
+        bool match_ellipse(const Config& config, const cv::RotatedRect& ellipse)
+        {
+            const float length = std::max(ellipse.size.width, ellipse.size.height);
+            const float thickness = std::min(ellipse.size.width, ellipse.size.height);
+
+            // Perpendicular to the frame is considered as 90 degrees, tilt left < 90, tilt right > 90
+            const float angle = ellipse.angle > 90 ? ellipse.angle - 90 : ellipse.angle + 90;
+
+            return thickness > 0 && length >= config.ratio_range.lower_bound * thickness &&
+                length <= config.ratio_range.upper_bound * thickness && std::abs(angle - 90) <= config.tilt_max;
+        }
+
+        /// Tiered tests of one contour, see rm::classify_contours.
+        template <typename Config>
+        contour_class classify_contour(const Config& config, const contour& contour, cv::RotatedRect& ellipse,
+                                       lightblob_filter_stats& counters)
+        {
+            // cheapest tier, the contour area never exceeds the area of its bounding rect
+            if (contour.size() < 6)
+            {
+                ++counters.points;
+                return CONTOUR_DROPPED;
+            }
+            const cv::Rect bounding = boundingRect(contour);
+            if (bounding.area() < config.area_range.lower_bound)
+            {
+                ++counters.bounding;
+                return CONTOUR_DROPPED;
+            }
+
+            if (!config.area_range.contains(contourArea(contour)))
+            {
+                ++counters.area;
+                return CONTOUR_DROPPED;
+            }
+
+            ellipse = fitEllipseDirect(contour);
+            if (!match_ellipse(config, ellipse))
+            {
+                ++counters.ellipse;
+                return CONTOUR_NEGATIVE;
+            }
+            ++counters.accepted;
+            return CONTOUR_POSITIVE;
+        }
+
+        /// Split component statistics into positive light blobs and negative components.
+        template <typename Config>
+        auto filter_blobs(const Config& config, const std::vector<blob_stats>& blobs, lightblob_filter_stats* stats)
+            -> std::tuple<std::vector<lightblob>, std::vector<blob_stats>>
+        {
+            std::vector<lightblob> positive;
+            std::vector<blob_stats> negative;
+            lightblob_filter_stats counters;
+
+            for (auto& blob : blobs)
+            {
+                ++counters.contours;
+                if (!config.area_range.contains(blob.area))
+                {
+                    ++counters.area;
+                    continue;
+                }
+
+                if (const cv::RotatedRect ellipse = blob.ellipse(); match_ellipse(config, ellipse))
+                {
+                    ++counters.accepted;
+                    positive.emplace_back(ellipse, config.enemy);
+                }
+                else
+                {
+                    ++counters.ellipse;
+                    negative.push_back(blob);
+                }
+            }
+
+            if (stats) *stats += counters;
+            return {positive, negative};
+        }
+
+        /// Sweep line pairing, see rm::pair_lightblobs. The shear limit is converted once per light blob into a range
+        /// of rectangle angles, tested with cross products instead of atan2 on every pair. The shear term of the score
+        /// is measured on the sine of the shear, which is also a cross product.
+        template <typename Config>
+        std::vector<lightblob_pair> pair_lightblobs(const Config& config, const lightblob_set& set)
+        {
+            constexpr float radian = static_cast<float>(CV_PI) / 180;
+
+            std::vector<lightblob_pair> pairs;
+            if (set.size() < 2) return pairs;
+
+            std::optional<overlap_index> index;
+            if (config.reject_overlap) index.emplace(set);
+
+            // the rectangle angle r = atan2(y, x) lies in [0, 90], the shear of a light blob stays within the limit
+            // when r lies in [lower, upper], tested as r >= lower: y cos(lower) >= x sin(lower) and r <= upper likewise
+            std::vector<cv::Vec4f> bounds(set.size());
+            std::vector<cv::Vec2f> directions(set.size());
+            std::vector<bool> reachable(set.size());
+            for (int i = 0; i < set.size(); ++i)
+            {
+                const float center = set.angle[i] > 90 ? set.angle[i] - 90 : 90 - set.angle[i];
+                const float lower = std::max(center - config.shear_max, 0.0f);
+                const float upper = std::min(center + config.shear_max, 90.0f);
+                reachable[i] = lower <= upper;
+                bounds[i] = {
+                    std::sin(lower * radian), std::cos(lower * radian), std::sin(upper * radian),
+                    std::cos(upper * radian)
+                };
+                directions[i] = {std::sin(center * radian), std::cos(center * radian)};
+            }
+            const auto within = [&bounds](const int i, const float x, const float y)
+            {
+                // atan2(0, 0) is 0, coincident centres are tested as a horizontal pair
+                if (x == 0 && y == 0) return bounds[i][0] <= 0;
+                return y * bounds[i][1] >= x * bounds[i][0] && x * bounds[i][2] >= y * bounds[i][3];
+            };
+            // the shear of a light blob is |center - r|, its sine is the cross product of the unit vectors at center
+            // and r
+            const auto shear_sine = [&directions](const int i, const float cos_r, const float sin_r)
+            {
+                return std::abs(directions[i][0] * cos_r - directions[i][1] * sin_r);
+            };
+            const float shear_limit = std::sin(config.shear_max * radian);
+
+            // a pair can only match when the horizontal distance is within (height_i + height_j) * 2, which is
+            // bounded by (height_i + height_max) * 2 for every blob further right
+            const float height_max = *std::max_element(set.height.begin(), set.height.end());
+            for (int i = 0; i < set.size(); ++i)
+            {
+                if (!reachable[i]) continue;
+                const float reach = (set.height[i] + height_max) * 2;
+
+                for (int begin = i + 1; begin < set.size(); begin += 64)
+                {
+                    const int end = static_cast<int>(std::partition_point(
+                        set.cx.begin() + begin, set.cx.begin() + std::min(begin + 64, set.size()),
+                        [&set, i, reach](const float x) { return x - set.cx[i] <= reach; }) - set.cx.begin());
+
+                    std::uint64_t mask =
+                        match_pairs(set, i, begin, end, config.angle_difference_max, config.lenght_ratio_max);
+                    for (int j = begin; mask; ++j, mask >>= 1)
+                    {
+                        if (!(mask & 1) || !reachable[j]) continue;
+
+                        const float y = std::abs(set.cy[i] - set.cy[j]);
+                        const float x = std::abs(set.cx[i] - set.cx[j]);
+                        if (!within(i, x, y) || !within(j, x, y)) continue;
+
+                        // a third light blob between the pair means the armour bridges across a neighbour
+                        if (index && index->contains(set.cx[i], set.cx[j], std::min(set.top[i], set.top[j]),
+                                                     std::max(set.bottom[i], set.bottom[j])))
+                            continue;
+
+                        // each term is 1 for an ideal pair and 0 at its limit, closer pairs are preferred over wide
+                        // ones which are more likely to be formed by light blobs of two adjacent armours, a zero
+                        // limit only admits ideal pairs so its term is 1 instead of 0 / 0, coincident centres are a
+                        // horizontal pair as in the gating
+                        const float distance = std::sqrt(x * x + y * y);
+                        const float cos_r = distance > 0 ? x / distance : 1, sin_r = distance > 0 ? y / distance : 0;
+                        const float heights = set.height[i] + set.height[j];
+                        const float ratio =
+                            std::min(set.height[i], set.height[j]) / std::max(set.height[i], set.height[j]);
+                        const float shear_pair = std::max(shear_sine(i, cos_r, sin_r), shear_sine(j, cos_r, sin_r));
+                        const float score =
+                            (config.angle_difference_max > 0
+                                 ? 1 - std::abs(set.angle[i] - set.angle[j]) / config.angle_difference_max
+                                 : 1) +
+                            (config.shear_max > 0 ? 1 - shear_pair / shear_limit : 1) +
+                            (config.lenght_ratio_max < 1
+                                 ? (ratio - config.lenght_ratio_max) / (1 - config.lenght_ratio_max)
+                                 : 1) +
+                            (1 - x / (heights * 2));
+
+                        pairs.push_back({std::min(set.index[i], set.index[j]), std::max(set.index[i], set.index[j]),
+                                         score / 4});
+                    }
+
+                    if (end < begin + 64) break;
+                }
+            }
+
+            // keep the order of the source light blobs
+            std::sort(pairs.begin(), pairs.end(), [](const lightblob_pair& a, const lightblob_pair& b)
+            {
+                return std::tie(a.first, a.second) < std::tie(b.first, b.second);
+            });
+            return pairs;
+        }
+
+        /// Pair, suppress and fit armours, see rm::filter_armours.
+        template <typename Config>
+        std::vector<armour> filter_armours(const Config& config, const std::vector<lightblob>& lightblobs)
+        {
+            if (lightblobs.size() < 2) return {};
+
+            auto pairs = pair_lightblobs(config, lightblob_set(lightblobs, config.enemy));
+            suppress_pairs(pairs, config.top_k);
+
+            std::vector<armour> armours;
+            armours.reserve(pairs.size());
+            for (auto& pair : pairs)
+            {
+                armours.emplace_back(armour_candidate(lightblobs[pair.first], lightblobs[pair.second], pair.score));
+            }
+
+            return armours;
+        }
+    }
+
+    /// Find light blobs from a set of contours with a compile time configuration, see the runtime filter_lightblobs.
+    /// \param contours Input contour (more than 6 points).
+    /// \param stats    Optional counters of each tier.
+    /// \param chunks   Number of chunks classified in parallel, see rm::classify_contours.
+    template <const detector_config& C>
+    auto filter_lightblobs(const std::vector<contour>& contours, lightblob_filter_stats* stats = nullptr,
+                           const int chunks = 1)
+        -> std::tuple<std::vector<lightblob>, std::vector<contour>>
+    {
+        const auto classify = [](const contour& contour, cv::RotatedRect& ellipse, lightblob_filter_stats& counters)
+        {
+            return detail::classify_contour(constant_config<C>(), contour, ellipse, counters);
+        };
+
+        return classify_contours(contours, C.enemy, classify, chunks, stats);
+    }
+
+    /// Find light blobs from a set of component statistics with a compile time configuration, see the runtime
+    /// filter_lightblobs.
+    /// \param blobs Input component statistics.
+    /// \param stats Optional counters, components are counted as contours.
+    template <const detector_config& C>
+    auto filter_lightblobs(const std::vector<blob_stats>& blobs, lightblob_filter_stats* stats = nullptr)
+        -> std::tuple<std::vector<lightblob>, std::vector<blob_stats>>
+    {
+        return detail::filter_blobs(constant_config<C>(), blobs, stats);
+    }
+
+    /// Pair light blobs of a set into scored armour candidates with a compile time configuration, see the runtime
+    /// pair_lightblobs.
+    /// \param set Light blob set.
+    /// \return Pairs of source indices (lower first), sorted ascending.
+    template <const detector_config& C>
+    std::vector<lightblob_pair> pair_lightblobs(const lightblob_set& set)
+    {
+        return detail::pair_lightblobs(constant_config<C>(), set);
+    }
+
+    /// Fit armours from a set of light blobs with a compile time configuration, see the runtime filter_armours.
+    /// \param lightblobs Input light blobs.
+    template <const detector_config& C>
+    std::vector<armour> filter_armours(const std::vector<lightblob>& lightblobs)
+    {
+        return detail::filter_armours(constant_config<C>(), lightblobs);
+    }
+}
+
+#endif //RMCV_DETECTOR_HPP
@@ -5,10 +5,129 @@
 #ifndef RMCV_IMGPROC_H
 #define RMCV_IMGPROC_H
 
+#include <array>
+
 #include "core.h"
 
 namespace rm
 {
+    /// Gamma transform with look up tables cached by quantised gamma factor, and a cheap brightness estimate.
+    class gamma_engine
+    {
+        std::vector<cv::Mat> tables; /// steps * gamma_max + 1 tables, never resized
+        int stride;
+
+    public:
+        static constexpr int steps = 64; /// Quantisation steps per unit of gamma factor
+        static constexpr float gamma_max = 8; /// Largest gamma factor, at most steps * gamma_max + 1 tables are cached
+
+        /// \param stride Row and column step of the pixels sampled by brightness().
+        explicit gamma_engine(int stride = 8);
+
+        /// Look up table of the given gamma factor, built on first use and valid for the lifetime of the engine. The
+        /// factor is clamped to [0, gamma_max], a non-finite factor fails with cv::Exception.
+        const cv::Mat& table(float gamma);
+
+        /// Apply the gamma transform in place.
+        void apply(cv::Mat& frame, float gamma);
+
+        /// Mean pixel value over all channels, estimated on a strided subsample of the frame (CV_8U only).
+        [[nodiscard]] float brightness(const cv::Mat& frame) const;
+    };
+
+    /// Binarization threshold chosen per frame by Otsu's method on a coarse histogram of the color difference plane,
+    /// sampled while the plane is computed and smoothed over time.
+    class adaptive_threshold
+    {
+        float current;
+        range<int> limits;
+        float smoothing;
+        int row_stride;
+
+    public:
+        static constexpr int bins = 64; /// Histogram bins over [0, 255]
+        typedef std::array<int, bins> histogram;
+
+        /// \param initial    Threshold of the first frame.
+        /// \param limits     Range the chosen threshold is clamped to.
+        /// \param smoothing  Weight of the newest frame in the exponential moving average.
+        /// \param row_stride Only every row_stride-th row (and every other pixel of it) is sampled.
+        explicit adaptive_threshold(int initial = 80, range<int> limits = {40, 200}, float smoothing = 0.1f,
+                                    int row_stride = 8);
+
+        /// Current threshold, the one used for the next frame.
+        [[nodiscard]] int value() const;
+
+        /// Row step of the sampled pixels.
+        [[nodiscard]] int stride() const;
+
+        /// Choose a new threshold from the histogram of the last frame.
+        void update(const histogram& counts);
+    };
+
+    /// Summed area table of the B, G and R planes computed once per frame, for O(1) mean colours of rectangles.
+    class color_integral
+    {
+        cv::Mat sums; /// CV_32SC3 integral of the (downsampled) frame
+        cv::Mat reduced;
+        int scale = 1;
+
+    public:
+        color_integral() = default;
+
+        /// \param source Source image (CV_8UC3).
+        /// \param scale  Downsample factor applied before integration.
+        explicit color_integral(const cv::Mat& source, int scale = 1);
+
+        /// Recompute the table for a new frame, reusing the buffers.
+        /// \param source Source image (CV_8UC3).
+        /// \param scale  Downsample factor applied before integration.
+        void compute(const cv::Mat& source, int scale = 1);
+
+        /// Mean value of each channel inside a rectangle at full resolution, rounded outwards to the downsampled grid.
+        /// \param rect Rectangle at full resolution.
+        /// \return Channel means, zero for a rectangle outside the frame.
+        [[nodiscard]] cv::Scalar mean(const cv::Rect& rect) const;
+
+        [[nodiscard]] bool empty() const { return sums.empty(); }
+    };
+
+    /// Buffers kept across frames by the preprocessing functions, so that they do not allocate in the steady state.
+    /// A workspace must not be shared by several threads at the same time.
+    struct preprocess_workspace
+    {
+        /// Horizontal run of foreground pixels, both ends inclusive.
+        struct run
+        {
+            int x0;
+            int x1;
+            int label;
+        };
+
+        /// Provisional labelling of one horizontal stripe.
+        struct stripe_labels
+        {
+            std::vector<run> runs; /// Runs of the stripe in raster order
+            std::vector<int> parent; /// Union-find forest of the provisional labels of the stripe
+            std::vector<blob_stats> provisional; /// Statistics of the provisional labels of the stripe
+            size_t first_row_end = 0; /// End of the runs on the first row of the stripe
+            size_t last_row_begin = 0; /// Begin of the runs on the last row of the stripe
+            int offset = 0; /// Label of the first provisional label of the stripe in the merged forest
+        };
+
+        cv::Mat binary; /// Binary image of the last binarization
+        cv::Mat gray; /// Gray image used by AutoBinarize
+        gamma_engine gamma; /// Cached gamma look up tables
+        std::vector<contour> contours; /// Contours of the last extraction
+        std::vector<blob_stats> blobs; /// Components of the last labelling
+        std::vector<uchar> rows; /// Row buffers of the fused binarization kernel
+        std::vector<cv::Rect> windows; /// Merged search windows of the last windowed binarization
+        std::vector<stripe_labels> labels; /// Stripes of the last labelling
+        std::vector<int> parent; /// Union-find forest of the provisional labels of all stripes
+        std::vector<blob_stats> provisional; /// Statistics of the provisional labels of all stripes
+        std::vector<adaptive_threshold::histogram> histograms; /// Difference histograms of each stripe
+    };
+
     /// Calibrate a portion of the source frame to the destine rect using Affine Transformation Correction.
     /// \param source Source image.
     /// \param vertices Vertices of the portion on the source frame.
@@ -16,28 +135,244 @@ namespace rm
     /// \return Calibrated image.
     cv::Mat affine_correction(const cv::Mat& source, cv::Point2f vertices[4], cv::Size outSize);
 
+    /// Rectify the icon of every armour straight into one row of a feature matrix, as affine_correction followed by
+    /// utils::flatten_image would, using a single affine map with bilinear sampling and no intermediate image.
+    /// \param source    Source image (CV_8U, 1 or 3 channels).
+    /// \param armours   Armours on the source image.
+    /// \param features  Output CV_32F matrix with one row of icon_size.area() * channels values per armour, released
+    ///                  when the source is not CV_8U.
+    /// \param icon_size Size of a rectified icon.
+    void rectify_icons(const cv::Mat& source, const std::vector<armour>& armours, cv::Mat& features,
+                       cv::Size icon_size = {20, 20});
+
     /// Perform a gamma transform on the input image.
     /// \param source Source image.
     /// \param calibration Output calibrated image.
     /// \param gamma Gamma factor.
     void CalcGamma(cv::Mat& source, cv::Mat& calibration, float gamma = 0.5f);
 
+    /// Perform a gamma transform on the input image with the cached look up table of the quantised gamma factor.
+    /// \param source      Source image.
+    /// \param calibration Output calibrated image.
+    /// \param gamma       Gamma factor.
+    /// \param workspace   Reused buffers.
+    void CalcGamma(cv::Mat& source, cv::Mat& calibration, float gamma, preprocess_workspace& workspace);
+
     /// Extract specified color from source image.
     /// \param image Source image.
     /// \param target Specify the camp of the color to be extracted.
     /// \param lower_bound Lower bound when performing binarization.
     std::tuple<std::vector<contour>, cv::Mat> extract_color(cv::InputArray image, camp target, int lower_bound);
 
+    /// Extract specified color inside the given search windows only.
+    /// \param image       Source image (CV_8UC3, BGR).
+    /// \param target      Specify the camp of the color to be extracted.
+    /// \param lower_bound Lower bound when performing binarization.
+    /// \param windows     Search windows on the source image, clipped to the frame and merged when overlapping.
+    /// \return Contours in full-frame coordinates and a full-frame binary image which is empty outside the windows.
+    std::tuple<std::vector<contour>, cv::Mat> extract_color(cv::InputArray image, camp target, int lower_bound,
+                                                            const std::vector<cv::Rect>& windows);
+
+    /// Binarize the specified color in a single pass over the interleaved source image. Produces the same mask as
+    /// extract_color (channel difference, binarization and 3x3 close operation) without intermediate planes.
+    /// \param image       Source image (CV_8UC3, BGR).
+    /// \param binary      Output binary image, released if the source is not CV_8UC3.
+    /// \param target      Specify the camp of the color to be extracted.
+    /// \param lower_bound Lower bound when performing binarization.
+    /// \param stripes     Number of horizontal stripes processed in parallel, the mask is identical for any count.
+    void binarize_color(cv::InputArray image, cv::Mat& binary, camp target, int lower_bound, int stripes = 1);
+
+    /// Binarize the specified color into the workspace, see binarize_color.
+    /// \param image       Source image (CV_8UC3, BGR).
+    /// \param target      Specify the camp of the color to be extracted.
+    /// \param lower_bound Lower bound when performing binarization.
+    /// \param workspace   Reused buffers, the binary image is written to workspace.binary.
+    /// \param stripes     Number of horizontal stripes processed in parallel.
+    void binarize_color(cv::InputArray image, camp target, int lower_bound, preprocess_workspace& workspace,
+                        int stripes = 1);
+
+    /// Binarize the specified color into the workspace inside the given search windows only, see binarize_color.
+    /// \param image       Source image (CV_8UC3, BGR).
+    /// \param target      Specify the camp of the color to be extracted.
+    /// \param lower_bound Lower bound when performing binarization.
+    /// \param windows     Search windows on the source image, clipped to the frame and merged when overlapping.
+    /// \param workspace   Reused buffers, the full-frame binary image is written to workspace.binary and is empty
+    ///                    outside the windows.
+    void binarize_color(cv::InputArray image, camp target, int lower_bound, const std::vector<cv::Rect>& windows,
+                        preprocess_workspace& workspace);
+
+    /// Binarize the specified color into the workspace with an adaptive threshold, see binarize_color. The histogram
+    /// of the color difference is gathered in the same pass and updates the threshold for the next frame.
+    /// \param image     Source image (CV_8UC3, BGR).
+    /// \param target    Specify the camp of the color to be extracted.
+    /// \param threshold Adaptive threshold, its current value is used and then updated.
+    /// \param workspace Reused buffers, the binary image is written to workspace.binary.
+    /// \param stripes   Number of horizontal stripes processed in parallel.
+    void binarize_color(cv::InputArray image, camp target, adaptive_threshold& threshold,
+                        preprocess_workspace& workspace, int stripes = 1);
+
+    /// Binarize the specified color into the workspace inside the given search windows only with an adaptive
+    /// threshold. The histogram is gathered over the windows, which mostly cover light blobs and their surroundings.
+    /// \param image     Source image (CV_8UC3, BGR).
+    /// \param target    Specify the camp of the color to be extracted.
+    /// \param threshold Adaptive threshold, its current value is used and then updated.
+    /// \param windows   Search windows on the source image, clipped to the frame and merged when overlapping.
+    /// \param workspace Reused buffers, the full-frame binary image is written to workspace.binary.
+    void binarize_color(cv::InputArray image, camp target, adaptive_threshold& threshold,
+                        const std::vector<cv::Rect>& windows, preprocess_workspace& workspace);
+
+    /// Extract specified color into the workspace with the fused kernel, see binarize_color. cv::findContours
+    /// allocates the contour vectors on every call, use binarize_color and label_blobs for an allocation free frame.
+    /// \param image       Source image (CV_8UC3, BGR).
+    /// \param target      Specify the camp of the color to be extracted.
+    /// \param lower_bound Lower bound when performing binarization.
+    /// \param workspace   Reused buffers, results are written to workspace.binary and workspace.contours.
+    /// \param stripes     Number of horizontal stripes processed in parallel.
+    void extract_color(cv::InputArray image, camp target, int lower_bound, preprocess_workspace& workspace,
+                       int stripes = 1);
+
+    /// Binarize the specified color on a raw 8 bit Bayer frame at half resolution. Each 2x2 cell becomes one pixel
+    /// holding the difference of its red and blue (or averaged green and red) samples, no demosaicing is performed.
+    /// \param raw         Raw Bayer frame (CV_8UC1).
+    /// \param binary      Output binary image of half the raw size, released if the source is not CV_8UC1.
+    /// \param pattern     Bayer pattern of the raw frame.
+    /// \param target      Specify the camp of the color to be extracted.
+    /// \param lower_bound Lower bound when performing binarization.
+    /// \param stripes     Number of horizontal stripes processed in parallel.
+    void binarize_bayer(const cv::Mat& raw, cv::Mat& binary, BayerPattern pattern, camp target, int lower_bound,
+                        int stripes = 1);
+
+    /// Binarize the specified color on a raw 8 bit Bayer frame into the workspace, see binarize_bayer.
+    /// \param raw         Raw Bayer frame (CV_8UC1).
+    /// \param pattern     Bayer pattern of the raw frame.
+    /// \param target      Specify the camp of the color to be extracted.
+    /// \param lower_bound Lower bound when performing binarization.
+    /// \param workspace   Reused buffers, the binary image is written to workspace.binary.
+    /// \param stripes     Number of horizontal stripes processed in parallel.
+    void binarize_bayer(const cv::Mat& raw, BayerPattern pattern, camp target, int lower_bound,
+                        preprocess_workspace& workspace, int stripes = 1);
+
+    /// Binarize the specified color on a raw 8 bit Bayer frame into the workspace inside the given search windows
+    /// only, see binarize_bayer.
+    /// \param raw         Raw Bayer frame (CV_8UC1).
+    /// \param pattern     Bayer pattern of the raw frame.
+    /// \param target      Specify the camp of the color to be extracted.
+    /// \param lower_bound Lower bound when performing binarization.
+    /// \param windows     Search windows at full resolution, rounded outwards to whole Bayer cells, clipped to the
+    ///                    frame and merged when overlapping.
+    /// \param workspace   Reused buffers, the half resolution binary image is written to workspace.binary and is
+    ///                    empty outside the windows.
+    void binarize_bayer(const cv::Mat& raw, BayerPattern pattern, camp target, int lower_bound,
+                        const std::vector<cv::Rect>& windows, preprocess_workspace& workspace);
+
+    /// Binarize the specified color on a raw 8 bit Bayer frame into the workspace with an adaptive threshold, see
+    /// binarize_bayer. The histogram of the cell differences is gathered in the same pass.
+    /// \param raw       Raw Bayer frame (CV_8UC1).
+    /// \param pattern   Bayer pattern of the raw frame.
+    /// \param target    Specify the camp of the color to be extracted.
+    /// \param threshold Adaptive threshold, its current value is used and then updated.
+    /// \param workspace Reused buffers, the half resolution binary image is written to workspace.binary.
+    /// \param stripes   Number of horizontal stripes processed in parallel.
+    void binarize_bayer(const cv::Mat& raw, BayerPattern pattern, camp target, adaptive_threshold& threshold,
+                        preprocess_workspace& workspace, int stripes = 1);
+
+    /// Binarize the specified color on a raw 8 bit Bayer frame into the workspace inside the given search windows
+    /// only with an adaptive threshold, the histogram is gathered over the windows.
+    /// \param raw       Raw Bayer frame (CV_8UC1).
+    /// \param pattern   Bayer pattern of the raw frame.
+    /// \param target    Specify the camp of the color to be extracted.
+    /// \param threshold Adaptive threshold, its current value is used and then updated.
+    /// \param windows   Search windows at full resolution, see the windowed binarize_bayer.
+    /// \param workspace Reused buffers, the half resolution binary image is written to workspace.binary.
+    void binarize_bayer(const cv::Mat& raw, BayerPattern pattern, camp target, adaptive_threshold& threshold,
+                        const std::vector<cv::Rect>& windows, preprocess_workspace& workspace);
+
+    /// Extract specified color from a raw 8 bit Bayer frame, see binarize_bayer.
+    /// \param raw         Raw Bayer frame (CV_8UC1).
+    /// \param pattern     Bayer pattern of the raw frame.
+    /// \param target      Specify the camp of the color to be extracted.
+    /// \param lower_bound Lower bound when performing binarization.
+    /// \return Contours in full resolution coordinates and the half resolution binary image.
+    std::tuple<std::vector<contour>, cv::Mat> extract_color_bayer(const cv::Mat& raw, BayerPattern pattern,
+                                                                  camp target, int lower_bound);
+
+    /// Extract specified color from a raw 8 bit Bayer frame inside the given search windows only, see binarize_bayer.
+    /// \param raw         Raw Bayer frame (CV_8UC1).
+    /// \param pattern     Bayer pattern of the raw frame.
+    /// \param target      Specify the camp of the color to be extracted.
+    /// \param lower_bound Lower bound when performing binarization.
+    /// \param windows     Search windows at full resolution, rounded outwards to whole Bayer cells, clipped to the
+    ///                    frame and merged when overlapping.
+    /// \return Contours in full resolution coordinates and the half resolution binary image which is empty outside
+    ///         the windows.
+    std::tuple<std::vector<contour>, cv::Mat> extract_color_bayer(const cv::Mat& raw, BayerPattern pattern,
+                                                                  camp target, int lower_bound,
+                                                                  const std::vector<cv::Rect>& windows);
+
+    /// Extract specified color from a raw 8 bit Bayer frame into the workspace, see binarize_bayer. cv::findContours
+    /// allocates the contour vectors on every call, use binarize_bayer and label_blobs for an allocation free frame.
+    /// \param raw         Raw Bayer frame (CV_8UC1).
+    /// \param pattern     Bayer pattern of the raw frame.
+    /// \param target      Specify the camp of the color to be extracted.
+    /// \param lower_bound Lower bound when performing binarization.
+    /// \param workspace   Reused buffers, the half resolution binary image is written to workspace.binary and the
+    ///                    contours in full resolution coordinates to workspace.contours.
+    /// \param stripes     Number of horizontal stripes processed in parallel.
+    void extract_color_bayer(const cv::Mat& raw, BayerPattern pattern, camp target, int lower_bound,
+                             preprocess_workspace& workspace, int stripes = 1);
+
+    /// Label 8-connected components of a binary image with a single run-length scan, accumulating area, bounding
+    /// box and moments of each component instead of tracing contours.
+    /// \param binary Binary image (CV_8UC1, non-zero pixels are foreground).
+    /// \return Statistics of each component, in raster order of their first pixel.
+    std::vector<blob_stats> label_blobs(const cv::Mat& binary);
+
+    /// Label 8-connected components of a binary image into the workspace, see label_blobs. Horizontal stripes are
+    /// labelled in parallel and their labels merged across the seams with union-find, the statistics and their order
+    /// do not depend on the stripe count.
+    /// \param binary    Binary image (CV_8UC1, non-zero pixels are foreground).
+    /// \param workspace Reused buffers, statistics are written to workspace.blobs.
+    /// \param stripes   Number of horizontal stripes labelled in parallel.
+    void label_blobs(const cv::Mat& binary, preprocess_workspace& workspace, int stripes = 1);
+
+    /// Demosaic a raw 8 bit Bayer frame to BGR.
+    /// \param raw     Raw Bayer frame (CV_8UC1).
+    /// \param image   Output BGR image.
+    /// \param pattern Bayer pattern of the raw frame.
+    void demosaic(const cv::Mat& raw, cv::Mat& image, BayerPattern pattern);
+
     /// Auto enhance image by the given benchmarks.
     /// \param frame Source image & destine image.
     /// \param maxGainFactor The mean value of pixel values where gain should be maximize.
     /// \param minGainFactor The mean value of pixel values where gain should be minimize.
     void AutoEnhance(cv::Mat& frame, float maxGainFactor = 100.0, float minGainFactor = 50.0);
 
+    /// Auto enhance image by the given benchmarks. The brightness is estimated on a strided subsample and the cached
+    /// look up tables are applied in place.
+    /// \param frame Source image & destine image.
+    /// \param engine Gamma engine holding the cached look up tables.
+    /// \param maxGainFactor The mean value of pixel values where gain should be maximize.
+    /// \param minGainFactor The mean value of pixel values where gain should be minimize.
+    void AutoEnhance(cv::Mat& frame, gamma_engine& engine, float maxGainFactor = 100.0, float minGainFactor = 50.0);
+
+    /// Auto enhance image by the given benchmarks with the gamma engine of the workspace.
+    /// \param frame Source image & destine image.
+    /// \param workspace Reused buffers.
+    /// \param maxGainFactor The mean value of pixel values where gain should be maximize.
+    /// \param minGainFactor The mean value of pixel values where gain should be minimize.
+    void AutoEnhance(cv::Mat& frame, preprocess_workspace& workspace, float maxGainFactor = 100.0,
+                     float minGainFactor = 50.0);
+
     /// Use the mean value of each channels to binarize given image and normalize to CV_32FC1.
     /// \param image Source image.
     /// \param binary Destine image.
     void AutoBinarize(cv::Mat& image, cv::Mat& binary);
+
+    /// Use the mean value of each channels to binarize given image and normalize to CV_32FC1.
+    /// \param image Source image.
+    /// \param binary Destine image, reused when it is already CV_32FC1 of the same size.
+    /// \param workspace Reused buffers.
+    void AutoBinarize(cv::Mat& image, cv::Mat& binary, preprocess_workspace& workspace);
 }
 
 #endif //RMCV_IMGPROC_H
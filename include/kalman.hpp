@@ -0,0 +1,72 @@
+//
+// Created by yaione on 10/18/26.
+//
+
+#ifndef RMCV_KALMAN_HPP
+#define RMCV_KALMAN_HPP
+
+#include <opencv2/core.hpp>
+
+namespace rm
+{
+    /// Linear Kalman filter with N states and M measurements on fixed size matrices, no heap storage. Behaves like
+    /// cv::KalmanFilter without control input: correct() starts from the last prediction, so a correction before the
+    /// first predict() sees a zero prior covariance and keeps the state. The covariance is corrected in Joseph form to
+    /// stay symmetric positive definite.
+    template <int N, int M, typename T = double>
+    class kalman
+    {
+    public:
+        typedef cv::Matx<T, N, 1> state_vector;
+        typedef cv::Matx<T, M, 1> measurement_vector;
+
+        state_vector prediction; /// Predicted state (statePre)
+        state_vector state; /// Corrected state (statePost)
+        cv::Matx<T, N, N> prior; /// Predicted error covariance (errorCovPre)
+        cv::Matx<T, N, N> covariance; /// Corrected error covariance (errorCovPost)
+        cv::Matx<T, N, N> transition; /// State transition matrix (F)
+        cv::Matx<T, M, N> observation; /// Measurement matrix (H)
+        cv::Matx<T, N, N> process_noise; /// Process noise covariance (Q)
+        cv::Matx<T, M, M> measurement_noise; /// Measurement noise covariance (R)
+
+        /// Identity transition and measurement matrices, diagonal covariances.
+        /// \param process_noise     Diagonal of the process noise covariance.
+        /// \param measurement_noise Diagonal of the measurement noise covariance.
+        /// \param error             Diagonal of the initial corrected error covariance.
+        explicit kalman(T process_noise = 0, T measurement_noise = 0, T error = 0) :
+            prediction(state_vector::zeros()), state(state_vector::zeros()), prior(cv::Matx<T, N, N>::zeros()),
+            covariance(cv::Matx<T, N, N>::eye() * error), transition(cv::Matx<T, N, N>::eye()),
+            observation(cv::Matx<T, M, N>::eye()), process_noise(cv::Matx<T, N, N>::eye() * process_noise),
+            measurement_noise(cv::Matx<T, M, M>::eye() * measurement_noise)
+        {
+        }
+
+        /// Propagate the corrected state and covariance through the transition.
+        const state_vector& predict()
+        {
+            prediction = transition * state;
+            prior = transition * covariance * transition.t() + process_noise;
+            state = prediction;
+            covariance = prior;
+            return prediction;
+        }
+
+        /// Correct the last prediction with a measurement.
+        /// \param measurement Measurement vector.
+        const state_vector& correct(const measurement_vector& measurement)
+        {
+            const cv::Matx<T, N, M> cross = prior * observation.t();
+            const cv::Matx<T, M, M> innovation = observation * cross + measurement_noise;
+            const cv::Matx<T, N, M> gain = cross * innovation.inv(cv::DECOMP_CHOLESKY);
+
+            state = prediction + gain * (measurement - observation * prediction);
+
+            // (I - KH) P (I - KH)^T + K R K^T
+            const cv::Matx<T, N, N> residual = cv::Matx<T, N, N>::eye() - gain * observation;
+            covariance = residual * prior * residual.t() + gain * measurement_noise * gain.t();
+            return state;
+        }
+    };
+}
+
+#endif //RMCV_KALMAN_HPP
@@ -6,6 +6,7 @@
 #define RMCV_OBJDETECT_H
 
 #include "core.h"
+#include "imgproc.h"
 
 namespace rm
 {
@@ -36,7 +37,132 @@ namespace rm
                         float maxRatio, float tiltAngle, float minArea, float maxArea, const cv::Mat& source,
                         bool fitEllipse = true);
 
-    /// Find light blobs from a set of contours.
+    /// Find light blobs from a set of contours. Auto detect light blob camp from a summed area table of the frame, in
+    /// constant time per light blob.
+    /// \param contours   Input contour (more than 6 points).
+    /// \param lightBlobs Output light blobs.
+    /// \param minRatio   Minimal aspect ratio.
+    /// \param maxRatio   Maximal aspect ratio.
+    /// \param tiltAngle  Maximal tilt angle.
+    /// \param minArea    Minimal contour area.
+    /// \param maxArea    Maximal contour area.
+    /// \param colors     Color integral of the source frame.
+    /// \param fitEllipse Use cv::fitEllipseDirect to box light blob instead of cv::minAreaRect when True.
+    void FindLightBlobs(std::vector<contour>& contours, std::vector<lightblob>& lightBlobs, float minRatio,
+                        float maxRatio, float tiltAngle, float minArea, float maxArea, const color_integral& colors,
+                        bool fitEllipse = true);
+
+    /// Find light blobs from a set of contours of a known camp, e.g. extracted by rm::extract_color, skipping the color
+    /// lookup entirely.
+    /// \param contours   Input contour (more than 6 points).
+    /// \param lightBlobs Output light blobs.
+    /// \param minRatio   Minimal aspect ratio.
+    /// \param maxRatio   Maximal aspect ratio.
+    /// \param tiltAngle  Maximal tilt angle.
+    /// \param minArea    Minimal contour area.
+    /// \param maxArea    Maximal contour area.
+    /// \param known      Camp of all contours.
+    /// \param fitEllipse Use cv::fitEllipseDirect to box light blob instead of cv::minAreaRect when True.
+    void FindLightBlobs(std::vector<contour>& contours, std::vector<lightblob>& lightBlobs, float minRatio,
+                        float maxRatio, float tiltAngle, float minArea, float maxArea, camp known,
+                        bool fitEllipse = true);
+
+    /// Counters of the contours handled by each tier of filter_lightblobs, accumulated across calls.
+    struct lightblob_filter_stats
+    {
+        int64 contours = 0; /// Contours examined
+        int64 points = 0; /// Rejected for having less than 6 points
+        int64 bounding = 0; /// Rejected for a bounding rect smaller than the minimal area
+        int64 area = 0; /// Rejected for a contour area out of range
+        int64 ellipse = 0; /// Negative for the aspect ratio or tilt of the fitted ellipse
+        int64 accepted = 0; /// Positive light blobs
+
+        lightblob_filter_stats& operator+=(const lightblob_filter_stats& other)
+        {
+            contours += other.contours;
+            points += other.points;
+            bounding += other.bounding;
+            area += other.area;
+            ellipse += other.ellipse;
+            accepted += other.accepted;
+            return *this;
+        }
+    };
+
+    /// Outcome of the tests on one contour.
+    enum contour_class
+    {
+        CONTOUR_DROPPED = 0, CONTOUR_NEGATIVE = 1, CONTOUR_POSITIVE = 2
+    };
+
+    /// Classify contours into light blobs, optionally in parallel. Every chunk of consecutive contours fills its own
+    /// buffers, which are merged in contour order so that the output does not depend on scheduling.
+    /// \param contours Input contours.
+    /// \param enemy    Camp of the positive light blobs.
+    /// \param classify Callable as classify(const contour&, cv::RotatedRect& ellipse, lightblob_filter_stats&),
+    ///                 returning a contour_class and setting the ellipse of positive contours.
+    /// \param chunks   Number of chunks classified in parallel with cv::parallel_for_, serial when 1.
+    /// \param stats    Optional counters of each tier.
+    template <typename Classifier>
+    auto classify_contours(const std::vector<contour>& contours, const camp enemy, const Classifier& classify,
+                           int chunks, lightblob_filter_stats* stats)
+        -> std::tuple<std::vector<lightblob>, std::vector<contour>>
+    {
+        struct chunk_result
+        {
+            std::vector<lightblob> positive;
+            std::vector<contour> negative;
+            lightblob_filter_stats counters;
+        };
+
+        const int count = static_cast<int>(contours.size());
+        chunks = std::max(std::min(chunks, count), 1);
+        std::vector<chunk_result> results(chunks);
+
+        const auto classify_chunks = [&](const cv::Range& range)
+        {
+            for (int chunk = range.start; chunk < range.end; ++chunk)
+            {
+                chunk_result& result = results[chunk];
+                const int end = static_cast<int>(static_cast<int64>(count) * (chunk + 1) / chunks);
+                for (int i = static_cast<int>(static_cast<int64>(count) * chunk / chunks); i < end; ++i)
+                {
+                    ++result.counters.contours;
+
+                    cv::RotatedRect ellipse;
+                    switch (classify(contours[i], ellipse, result.counters))
+                    {
+                    case CONTOUR_POSITIVE:
+                        result.positive.emplace_back(ellipse, enemy);
+                        break;
+                    case CONTOUR_NEGATIVE:
+                        result.negative.push_back(contours[i]);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+            }
+        };
+
+        if (chunks == 1) classify_chunks(cv::Range(0, 1));
+        else cv::parallel_for_(cv::Range(0, chunks), classify_chunks);
+
+        std::vector<lightblob> positive;
+        std::vector<contour> negative;
+        for (auto& result : results)
+        {
+            positive.insert(positive.end(), result.positive.begin(), result.positive.end());
+            negative.insert(negative.end(), std::make_move_iterator(result.negative.begin()),
+                            std::make_move_iterator(result.negative.end()));
+            if (stats) *stats += result.counters;
+        }
+
+        return {positive, negative};
+    }
+
+    /// Find light blobs from a set of contours. Cheap tests run first (point count, bounding rect area, contour area),
+    /// the ellipse is only fitted on the survivors.
     /// \param contours    Input contour (more than 6 points).
     /// \param positive    Output positive light blobs.
     /// \param negative    Output negative light blobs.
@@ -44,31 +170,150 @@ namespace rm
     /// \param ratio_range Aspect ratio range.
     /// \param area_range  Area range.
     /// \param enemy       Enemy camp.
+    /// \param stats       Optional counters of each tier.
+    /// \param chunks      Number of chunks classified in parallel, see rm::classify_contours.
     auto filter_lightblobs(const std::vector<contour>& contours, float tilt_max, range<float> ratio_range,
-                           range<double> area_range, camp enemy)
+                           range<double> area_range, camp enemy, lightblob_filter_stats* stats = nullptr,
+                           int chunks = 1)
         -> std::tuple<std::vector<lightblob>, std::vector<contour>>;
 
-    /// Find guid light
-    /// \param lightBlobs
-    /// \param source
-    /// \return
+    /// Find light blobs from a set of component statistics, see rm::label_blobs. Ellipses are computed in closed form
+    /// from the moments, the area is the pixel count of the component.
+    /// \param blobs       Input component statistics.
+    /// \param tilt_max    Maximal tilt angle.
+    /// \param ratio_range Aspect ratio range.
+    /// \param area_range  Area range.
+    /// \param enemy       Enemy camp.
+    /// \param stats       Optional counters, components are counted as contours and only the area, ellipse and
+    ///                    accepted tiers apply.
+    auto filter_lightblobs(const std::vector<blob_stats>& blobs, float tilt_max, range<float> ratio_range,
+                           range<double> area_range, camp enemy, lightblob_filter_stats* stats = nullptr)
+        -> std::tuple<std::vector<lightblob>, std::vector<blob_stats>>;
+
+    /// Coarse stage of the coarse-to-fine detection: find light blob candidates on a 2x downsampled frame and return
+    /// full resolution search windows around them, to be refined with the windowed binarize_color. Candidates are
+    /// labelled components tested on their area, bounding box orientation and upper aspect ratio only, so that light
+    /// blobs of far targets, a few pixels at half resolution, are kept.
+    /// \param image         Source image (CV_8UC3, BGR).
+    /// \param target        Specify the camp of the color to be extracted.
+    /// \param lower_bound   Lower bound when performing binarization.
+    /// \param tilt_max      Maximal tilt angle.
+    /// \param ratio_range   Aspect ratio range.
+    /// \param area_range    Area range at full resolution.
+    /// \param margin        Margin added around each candidate, in light blob heights.
+    /// \return Search windows at full resolution.
+    std::vector<cv::Rect> coarse_windows(const cv::Mat& image, camp target, int lower_bound, float tilt_max,
+                                         range<float> ratio_range, range<double> area_range, float margin = 0.5f);
+
+    /// Find guid light among light blobs classified by FindLightBlobs, the largest roughly round guide light blob
+    /// that is green dominant on the source frame.
+    /// \param lightBlobs Light blobs of all camps.
+    /// \param source     Source image (3 channels BGR), skip the color check when empty.
+    /// \return Index of the guide light, -1 if there is none.
     int FindGuidLight(const std::vector<rm::lightblob>& lightBlobs, const cv::Mat& source);
 
-    /// Detect if there is a overlap over all light blobs at the given pair of light blobs.
+    /// Detect guide lights on the green minus red plane inside a horizontal band of the frame. Components are labeled
+    /// without tracing contours and tested on their moments: axis ratio and fill of the equivalent ellipse.
+    /// \param image           Source image (CV_8UC3, BGR).
+    /// \param lower_bound     Lower bound when performing binarization.
+    /// \param workspace       Reused buffers, must not be shared with the armour detection of the same frame.
+    /// \param band            Rows searched, as fractions of the frame height from the top.
+    /// \param area_range      Area range in pixels.
+    /// \param circularity_min Minimal minor to major axis ratio, and minimal fill of the ellipse.
+    /// \return Guide lights (CAMP_GUIDELIGHT) in frame coordinates, largest first.
+    std::vector<lightblob> find_guidelights(const cv::Mat& image, int lower_bound, preprocess_workspace& workspace,
+                                            range<float> band = {0, 0.5f}, range<double> area_range = {20, 8000},
+                                            float circularity_min = 0.7f);
+
+    /// Detect guide lights with an adaptive threshold on the green minus red plane, see find_guidelights. The
+    /// histogram is gathered over the band and updates the threshold for the next frame.
+    /// \param image           Source image (CV_8UC3, BGR).
+    /// \param threshold       Adaptive threshold of the guide lights, not shared with the armour detection.
+    /// \param workspace       Reused buffers, must not be shared with the armour detection of the same frame.
+    /// \param band            Rows searched, as fractions of the frame height from the top.
+    /// \param area_range      Area range in pixels.
+    /// \param circularity_min Minimal minor to major axis ratio, and minimal fill of the ellipse.
+    /// \return Guide lights (CAMP_GUIDELIGHT) in frame coordinates, largest first.
+    std::vector<lightblob> find_guidelights(const cv::Mat& image, adaptive_threshold& threshold,
+                                            preprocess_workspace& workspace, range<float> band = {0, 0.5f},
+                                            range<double> area_range = {20, 8000}, float circularity_min = 0.7f);
+
+    /// Detect if there is a overlap over all light blobs at the given pair of light blobs. Linear in the distance
+    /// between the indices, see rm::overlap_index for the indexed test used by filter_armours.
     /// \param lightBlobs All light blobs on the frame (must be sorted ascending by x).
     /// \param leftIndex  Index of the left light blob.
     /// \param rightIndex Index of the right light blob.
     /// \return True if there is a overlap;
     bool LightBlobOverlap(const std::vector<rm::lightblob>& lightBlobs, int leftIndex, int rightIndex);
 
-    /// Fit armours from a set of light blobs.
+    /// Merge sort tree over a light blob set, answers whether any light blob lies strictly inside a box in
+    /// O(log^2 n).
+    class overlap_index
+    {
+        std::vector<float> cx;
+        std::vector<std::vector<float>> levels; /// Center y sorted within aligned blocks of 2^level light blobs
+
+    public:
+        explicit overlap_index(const lightblob_set& set);
+
+        /// Test if the center of a light blob lies strictly inside the box.
+        /// \param x_min Left edge.
+        /// \param x_max Right edge.
+        /// \param y_min Upper edge.
+        /// \param y_max Lower edge.
+        /// \return True if there is a light blob inside.
+        [[nodiscard]] bool contains(float x_min, float x_max, float y_min, float y_max) const;
+    };
+
+    /// Test one light blob against a block of candidates of the same set with the cheap pairing conditions (distance,
+    /// length ratio and angle difference), vectorised when SIMD is available.
+    /// \param set                  Light blob set.
+    /// \param i                    Index of the light blob in the set.
+    /// \param begin                First candidate index.
+    /// \param end                  End of the candidate range, at most 64 after begin.
+    /// \param angle_difference_max Maximal angle difference between two light blobs.
+    /// \param lenght_ratio_max     Maximal length ratio between two light blobs.
+    /// \return Bit k is set when candidate begin + k passes.
+    std::uint64_t match_pairs(const lightblob_set& set, int i, int begin, int end, float angle_difference_max,
+                              float lenght_ratio_max);
+
+    /// Armour candidate formed by two light blobs.
+    struct lightblob_pair
+    {
+        int first; /// Source index of the first light blob (the lower index)
+        int second; /// Source index of the second light blob
+        float score; /// Geometric score in [0, 1], higher is better
+    };
+
+    /// Pair light blobs of a set into armour candidates, each scored on angle difference, shear, length ratio and
+    /// spacing.
+    /// \param set                  Light blob set.
+    /// \param angle_difference_max Maximal angle difference between two light blobs.
+    /// \param shear_max            Maximal shear between two light blobs with the rectangle.
+    /// \param lenght_ratio_max     Maximal length ratio between two light blobs.
+    /// \param reject_overlap       Reject pairs with another light blob between them, within their vertical span.
+    /// \return Pairs of source indices (lower first), sorted ascending.
+    std::vector<lightblob_pair> pair_lightblobs(const lightblob_set& set, float angle_difference_max,
+                                                float shear_max, float lenght_ratio_max, bool reject_overlap = true);
+
+    /// Greedy non-maximum suppression, keep the best scored candidates so that each light blob belongs to at most one
+    /// armour. Candidates are left sorted descending by score.
+    /// \param pairs Armour candidates.
+    /// \param top_k Maximal number of candidates to keep, unlimited when not positive.
+    void suppress_pairs(std::vector<lightblob_pair>& pairs, int top_k = 0);
+
+    /// Fit armours from a set of light blobs. Candidates are paired with a sweep over the light blobs sorted by x, then
+    /// suppressed so that each light blob is used once, armours are returned descending by score.
     /// \param lightblobs           Input light blobs.
     /// \param angle_difference_max Maximal angle difference between two light blobs.
     /// \param shear_max            Maximal shear between two light blobs with the rectangle.
     /// \param lenght_ratio_max     Maximal length ratio between two light blobs.
     /// \param enemy                Enemy camp.
+    /// \param reject_overlap       Reject pairs bridging across a third light blob.
+    /// \param top_k                Maximal number of armours, unlimited when not positive.
     std::vector<armour> filter_armours(std::vector<lightblob>& lightblobs,
-                        float angle_difference_max, float shear_max, float lenght_ratio_max, camp enemy);
+                        float angle_difference_max, float shear_max, float lenght_ratio_max, camp enemy,
+                        bool reject_overlap = true, int top_k = 0);
 }
 
 #endif //RMCV_OBJDETECT_H
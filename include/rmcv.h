@@ -14,10 +14,13 @@
 #include "core.h"
 #include "imgproc.h"
 #include "objdetect.h"
+#include "tracker.h"
 #include "debug.h"
 #include "mobility.h"
 #include "svm.h"
 
+#include "detector.hpp"
+#include "kalman.hpp"
 #include "parallequeue.hpp"
 
 
@@ -0,0 +1,161 @@
+//
+// Created by yaione on 10/18/26.
+//
+
+#ifndef RMCV_TRACKER_H
+#define RMCV_TRACKER_H
+
+#include "core.h"
+
+namespace rm
+{
+    /// Bounding boxes of armours as structure of arrays, for vectorised IoU.
+    struct box_set
+    {
+        std::vector<float> x; /// Left edge of each box
+        std::vector<float> y; /// Top edge of each box
+        std::vector<float> width; /// Width of each box
+        std::vector<float> height; /// Height of each box
+
+        /// Replace the content with the bounding boxes of the armours.
+        /// \param armours Source armours.
+        /// \param count   Number of armours to take from the front, all when negative.
+        void assign(const std::vector<armour>& armours, int count = -1);
+
+        [[nodiscard]] int size() const { return static_cast<int>(x.size()); }
+    };
+
+    /// Fill the IoU matrix of two sets of boxes, vectorised along the columns, and find the best column of each row.
+    /// \param rows   Boxes of the rows (e.g. tracks).
+    /// \param cols   Boxes of the columns (e.g. detections).
+    /// \param iou    Output IoU, rows.size() x cols.size() in row-major order.
+    /// \param argmax Output column with the largest positive IoU of each row, -1 when none overlaps (optional).
+    void iou_matrix(const box_set& rows, const box_set& cols, std::vector<float>& iou,
+                    std::vector<int>* argmax = nullptr);
+
+    /// Constant velocity Kalman filters of all tracks stored as structure of arrays. The state of each track is
+    /// (position, velocity) along x, y and z, measured directly with diagonal noise, so the filter splits into one
+    /// independent 2x2 block per axis: only the three distinct covariance entries of each block are stored, and all
+    /// tracks are predicted together with vectorised loops.
+    class track_bank
+    {
+    public:
+        /// One axis of every track, each array holds capacity entries.
+        struct axis
+        {
+            std::vector<double> position;
+            std::vector<double> velocity;
+            std::vector<double> pp; /// Position variance
+            std::vector<double> pv; /// Position velocity covariance
+            std::vector<double> vv; /// Velocity variance
+            std::vector<double> measured; /// Last measured position, for the measured velocity
+        };
+
+    private:
+        std::array<axis, 3> axes;
+        std::vector<int64> measured_at;
+        int count = 0;
+        axis gathered; /// One axis of the corrected tracks, contiguous for the vectorised update
+        std::vector<double> gathered_velocity; /// Measured velocities of the corrected tracks
+        double process_noise, measurement_noise, error;
+
+    public:
+        /// \param capacity          Maximal number of tracks.
+        /// \param process_noise     Process noise variance of every state.
+        /// \param measurement_noise Measurement noise variance of every state.
+        /// \param error             Initial error variance of the velocities, positions start at the measurement noise.
+        explicit track_bank(int capacity = 32, double process_noise = 5e-5, double measurement_noise = 0.5,
+                            double error = 0.05);
+
+        /// Start a track at its first measurement with zero velocity.
+        /// \return Index of the track, -1 when the bank is full.
+        int add(const cv::Point3d& position, int64 timestamp);
+
+        /// Move the track at index from to index to, overwriting it (used to compact the bank).
+        void move(int from, int to);
+
+        /// Keep the first count tracks.
+        void resize(int count);
+
+        /// Predict every track forward by the same interval.
+        /// \param dt Interval in seconds.
+        void predict_all(double dt);
+
+        /// Correct a subset of tracks with measured positions, velocities are measured as the difference to the
+        /// previous measurement of each track. Each axis of the subset is gathered into contiguous arrays, corrected
+        /// with SIMD and scattered back.
+        /// \param indices    Indices of the tracks.
+        /// \param positions  Measured positions.
+        /// \param timestamps Tick counts of the measurements.
+        /// \param subset     Number of tracks corrected.
+        void correct_subset(const int* indices, const cv::Point3d* positions, const int64* timestamps, int subset);
+
+        [[nodiscard]] cv::Point3d position(int index) const;
+
+        [[nodiscard]] cv::Point3d velocity(int index) const;
+
+        [[nodiscard]] int size() const { return count; }
+    };
+
+    /// Multi-target armour tracker. Every frame the detections are assigned to the tracks globally with the Hungarian
+    /// method on a gated cost of bounding box IoU and 3D distance, storage is preallocated for a fixed capacity.
+    class tracker
+    {
+        std::vector<armour> tracks;
+        track_bank bank; /// Filtered state of each track, same order as tracks
+        int64 timestamp = 0; /// Tick count the bank is predicted to
+        int capacity;
+        float iou_min;
+        double distance_max;
+        int lost_max;
+
+        // per frame buffers, sized for capacity x capacity
+        box_set track_boxes, detection_boxes;
+        std::vector<float> iou;
+        std::vector<double> cost;
+        std::vector<int> assignment;
+        std::vector<int> corrected;
+        std::vector<cv::Point3d> measured_positions;
+        std::vector<int64> measured_at;
+        std::vector<bool> detection_matched;
+        std::vector<double> u, v, slack;
+        std::vector<int> row_of, previous;
+        std::vector<bool> visited;
+
+        void solve(int rows, int cols, bool transposed);
+
+    public:
+        static constexpr double gated = 1e6; /// Cost of a pair outside the gate
+
+        /// \param capacity     Maximal number of tracks and of detections considered per frame.
+        /// \param iou_min      Minimal bounding box IoU of a match, unless the positions are close.
+        /// \param distance_max Maximal 3D distance of a match, unless the bounding boxes overlap.
+        /// \param lost_max     Frames a track survives without a match.
+        explicit tracker(int capacity = 32, float iou_min = 0.3f, double distance_max = 200, int lost_max = 25);
+
+        /// Cost of assigning a detection to a track, in [0, 2] inside the gate.
+        /// \param iou      Bounding box IoU of the pair.
+        /// \param distance 3D distance of the pair.
+        /// \return Cost, tracker::gated when the pair is outside the gate.
+        [[nodiscard]] double match_cost(float iou, double distance) const;
+
+        /// Predict all tracks to the frame, assign the detections, correct matched tracks, age and drop lost tracks
+        /// and start new tracks. The frame time is taken from the detections, an empty frame only ages the tracks.
+        /// \param detections Armours detected on the frame.
+        void update(const std::vector<armour>& detections);
+
+        void clear()
+        {
+            tracks.clear();
+            bank.resize(0);
+        }
+
+        /// Tracked armours with the geometry and position of their last detection.
+        [[nodiscard]] const std::vector<armour>& targets() const { return tracks; }
+
+        /// Filtered position and velocity of each target, same indices as targets().
+        [[nodiscard]] const track_bank& states() const { return bank; }
+    };
+}
+
+#endif //RMCV_TRACKER_H
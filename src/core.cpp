@@ -18,132 +18,182 @@ namespace rm
         this->size = {std::min(box.size.height, box.size.width), std::max(box.size.height, box.size.width)};
     }
 
-    armour::armour(std::vector<lightblob> lightblobs) : observer(6, 6, 0, CV_64F)
+    void blob_stats::merge(const blob_stats& other)
     {
-        if (lightblobs.size() != 2) return;
-
-        // sort light blobs left to right
-        std::sort(lightblobs.begin(), lightblobs.end(),
-                  [](const lightblob& lightBar1, const lightblob& lightBar2)
-                  {
-                      return lightBar1.center.x < lightBar2.center.x;
-                  });
+        bounding_box = area == 0 ? other.bounding_box : bounding_box | other.bounding_box;
+        area += other.area;
+        sum_x += other.sum_x;
+        sum_y += other.sum_y;
+        sum_xx += other.sum_xx;
+        sum_xy += other.sum_xy;
+        sum_yy += other.sum_yy;
+    }
 
-        int i = 0, j = 3;
-        for (const auto& lightBar : lightblobs)
-        {
-            vertices[i++] = lightBar.vertices[j--];
-            vertices[i++] = lightBar.vertices[j--];
-        }
+    blob_stats blob_stats::scaled(const int factor) const
+    {
+        // pixel u covers u * k + i for i in [0, k), s1 and s2 are the sums of i and i^2
+        const double k = factor, s1 = k * (k - 1) / 2, s2 = (k - 1) * k * (2 * k - 1) / 6;
+
+        blob_stats stats;
+        stats.area = area * factor * factor;
+        stats.bounding_box = {
+            bounding_box.x * factor, bounding_box.y * factor, bounding_box.width * factor,
+            bounding_box.height * factor
+        };
+        stats.sum_x = k * k * k * sum_x + k * s1 * area;
+        stats.sum_y = k * k * k * sum_y + k * s1 * area;
+        stats.sum_xx = k * k * k * k * sum_xx + 2 * k * k * s1 * sum_x + k * s2 * area;
+        stats.sum_xy = k * k * k * k * sum_xy + k * k * s1 * (sum_x + sum_y) + s1 * s1 * area;
+        stats.sum_yy = k * k * k * k * sum_yy + 2 * k * k * s1 * sum_y + k * s2 * area;
+        return stats;
+    }
 
-        float distanceL = utils::PointDistance(vertices[0], vertices[1]);
-        float distanceR = utils::PointDistance(vertices[2], vertices[3]);
-        float offsetL = round((distanceL / 0.50f - distanceL) / 2);
-        float offsetR = round((distanceR / 0.50f - distanceR) / 2);
-        utils::ExtendCord(vertices[0], vertices[1], offsetL, icon[0], icon[1]);
-        utils::ExtendCord(vertices[3], vertices[2], offsetR, icon[3], icon[2]);
+    cv::Point2f blob_stats::center() const
+    {
+        if (area == 0) return {};
+        return {static_cast<float>(sum_x / area), static_cast<float>(sum_y / area)};
+    }
 
-        bounding_box = boundingRect(std::vector(icon, icon + 4));
+    cv::RotatedRect blob_stats::ellipse() const
+    {
+        if (area == 0) return {};
+
+        const double cx = sum_x / area, cy = sum_y / area;
+
+        // central moments, each pixel is a unit square contributing 1/12 of variance along both axes
+        const double mu20 = sum_xx / area - cx * cx + 1.0 / 12.0;
+        const double mu02 = sum_yy / area - cy * cy + 1.0 / 12.0;
+        const double mu11 = sum_xy / area - cx * cy;
+
+        // eigenvalues of the covariance matrix, a solid ellipse with axis a has a variance of (a / 4)^2 along it
+        const double mean = (mu20 + mu02) / 2;
+        const double spread = std::sqrt((mu20 - mu02) * (mu20 - mu02) / 4 + mu11 * mu11);
+        const double major = 4 * std::sqrt(mean + spread);
+        const double minor = 4 * std::sqrt(std::max(mean - spread, 0.0));
+
+        // the width (minor) axis is perpendicular to the major axis
+        double angle = 0.5 * std::atan2(2 * mu11, mu20 - mu02) * 180.0 / CV_PI + 90.0;
+        if (angle >= 180) angle -= 180;
+        if (angle < 0) angle += 180;
+
+        return {
+            {static_cast<float>(cx), static_cast<float>(cy)},
+            {static_cast<float>(minor), static_cast<float>(major)},
+            static_cast<float>(angle)
+        };
+    }
 
-        utils::CalcPerspective(vertices, vertices);
+    identity_histogram::identity_histogram(const float decay) : factor(decay)
+    {
     }
 
-    void armour::reset(const double process_noise, const double measurement_noise, const double error)
+    void identity_histogram::decay()
     {
-        setIdentity(observer.measurementMatrix);
-        setIdentity(observer.processNoiseCov, cv::Scalar::all(process_noise));
-        setIdentity(observer.measurementNoiseCov, cv::Scalar::all(measurement_noise));
-        setIdentity(observer.errorCovPost, cv::Scalar::all(error));
-
-        measurement = cv::Mat::zeros(6, 1, CV_64F);
-
-        observer.transitionMatrix = (cv::Mat_<double>(6, 6, CV_64F) <<
-            1, 0, 0, 1, 0, 0,
-            0, 1, 0, 0, 1, 0,
-            0, 0, 1, 0, 0, 1,
-            0, 0, 0, 1, 0, 0,
-            0, 0, 0, 0, 1, 0,
-            0, 0, 0, 0, 0, 1);
-
-        initialized = false;
+        for (auto& vote : votes) vote *= factor;
     }
 
-    void armour::update(const armour& new_observation)
+    void identity_histogram::vote(const int identity)
     {
-        if (identity_history.find(new_observation.identity) == identity_history.end())
-            identity_history[new_observation.identity] = 1;
-        else
-            identity_history[new_observation.identity]++;
+        if (identity >= 0 && identity < labels) votes[identity] += 1;
+    }
 
-        if (initialized)
+    std::tuple<int, double> identity_histogram::max() const
+    {
+        int max_id = -1;
+        float max = 0;
+        for (int i = 0; i < labels; ++i)
         {
-            const auto delta_tick = new_observation.timestamp - timestamp;
-            const double dt = static_cast<double>(delta_tick) / cv::getTickFrequency();
+            if (votes[i] > max)
+            {
+                max = votes[i];
+                max_id = i;
+            }
+        }
+        if (max_id < 0) return {-1, 0};
 
-            observer.transitionMatrix.at<double>(0, 3) = dt;
-            observer.transitionMatrix.at<double>(1, 4) = dt;
-            observer.transitionMatrix.at<double>(2, 5) = dt;
+        // exp(max) / sum(exp(votes)) = 1 / sum(exp(votes - max)) over the identities voted for, every exponent is at
+        // most 0
+        double sum = 0;
+        for (const float vote : votes)
+            if (vote > 0) sum += std::exp(static_cast<double>(vote - max));
 
-            observer.predict();
+        return {max_id, 1 / sum};
+    }
 
-            measurement.at<double>(3) = (new_observation.position.x - measurement.at<double>(0)) / dt;
-            measurement.at<double>(4) = (new_observation.position.y - measurement.at<double>(1)) / dt;
-            measurement.at<double>(5) = (new_observation.position.z - measurement.at<double>(2)) / dt;
+    lightblob_set::lightblob_set(const std::vector<lightblob>& lightblobs, const camp camp)
+    {
+        assign(lightblobs, camp);
+    }
 
-            measurement.at<double>(0) = new_observation.position.x;
-            measurement.at<double>(1) = new_observation.position.y;
-            measurement.at<double>(2) = new_observation.position.z;
+    void lightblob_set::assign(const std::vector<lightblob>& lightblobs, const camp camp)
+    {
+        clear();
 
-            observer.correct(measurement);
-        }
-        else
+        for (int i = 0; i < lightblobs.size(); ++i)
+            if (lightblobs[i].target == camp) index.push_back(i);
+        std::stable_sort(index.begin(), index.end(), [&lightblobs](const int a, const int b)
         {
-            measurement.at<double>(0) = new_observation.position.x;
-            measurement.at<double>(1) = new_observation.position.y;
-            measurement.at<double>(2) = new_observation.position.z;
+            return lightblobs[a].center.x < lightblobs[b].center.x;
+        });
 
-            observer.correct(measurement);
-            initialized = true;
+        for (const int i : index)
+        {
+            cx.push_back(lightblobs[i].center.x);
+            cy.push_back(lightblobs[i].center.y);
+            angle.push_back(lightblobs[i].angle);
+            height.push_back(lightblobs[i].size.height);
+            width.push_back(lightblobs[i].size.width);
+            top.push_back(std::min(lightblobs[i].vertices[1].y, lightblobs[i].vertices[2].y));
+            bottom.push_back(std::max(lightblobs[i].vertices[0].y, lightblobs[i].vertices[3].y));
+            target.push_back(lightblobs[i].target);
         }
+    }
 
-        timestamp = new_observation.timestamp;
+    void lightblob_set::clear()
+    {
+        cx.clear();
+        cy.clear();
+        angle.clear();
+        height.clear();
+        width.clear();
+        top.clear();
+        bottom.clear();
+        target.clear();
+        index.clear();
     }
 
-    void armour::update(const int64 new_timestamp)
+    armour::armour(std::vector<lightblob> lightblobs)
     {
-        if (!initialized) return;
+        if (lightblobs.size() != 2) return;
+        *this = armour(armour_candidate(lightblobs[0], lightblobs[1]));
+    }
 
-        const auto delta_tick = new_timestamp - timestamp;
-        const double dt = static_cast<double>(delta_tick) / cv::getTickFrequency();
+    armour::armour(const armour_candidate& candidate) : score(candidate.score)
+    {
+        vertices[0] = candidate.left->vertices[3];
+        vertices[1] = candidate.left->vertices[2];
+        vertices[2] = candidate.right->vertices[1];
+        vertices[3] = candidate.right->vertices[0];
+
+        float distanceL = utils::PointDistance(vertices[0], vertices[1]);
+        float distanceR = utils::PointDistance(vertices[2], vertices[3]);
+        float offsetL = round((distanceL / 0.50f - distanceL) / 2);
+        float offsetR = round((distanceR / 0.50f - distanceR) / 2);
+        utils::ExtendCord(vertices[0], vertices[1], offsetL, icon[0], icon[1]);
+        utils::ExtendCord(vertices[3], vertices[2], offsetR, icon[3], icon[2]);
 
-        observer.transitionMatrix.at<double>(0, 3) = dt;
-        observer.transitionMatrix.at<double>(1, 4) = dt;
-        observer.transitionMatrix.at<double>(2, 5) = dt;
+        // header over the member array, no copy
+        bounding_box = boundingRect(cv::Mat(4, 1, CV_32FC2, icon));
 
-        observer.predict();
+        utils::CalcPerspective(vertices, vertices);
     }
 
     std::tuple<int, double> armour::identity_max() const
     {
-        double sum = 0;
-        for (const auto& [fst, snd] : identity_history) sum += exp(snd);
-
-        double max = 0;
-        int max_id = -1;
-        for (const auto& [fst, snd] : identity_history)
-        {
-            if (const double prob = exp(snd) / sum;
-                prob > max)
-            {
-                max = prob;
-                max_id = fst;
-            }
-        }
-
-        return {max_id, max};
+        return identity_history.max();
     }
 
-    std::tuple<int, float> armour::max_IoU(std::vector<armour> armours) const
+    std::tuple<int, float> armour::max_IoU(const std::vector<armour>& armours) const
     {
         int index = -1;
         float max = 0;
@@ -235,7 +285,7 @@ namespace rm::utils
             boundingRect.x -= scale.width;
             boundingRect.y -= scale.height;
             boundingRect.width += scale.width * 2;
-            boundingRect.height += scale.width * 2;
+            boundingRect.height += scale.height * 2;
         }
         if (boundingRect.x < 0)
         {
@@ -40,6 +40,49 @@ namespace rm::debug
         storage << "data" << data;
     }
 
+    void stage_timer::start()
+    {
+        last = cv::getTickCount();
+        frames++;
+    }
+
+    void stage_timer::lap(const std::string& name)
+    {
+        const int64 now = cv::getTickCount();
+        const auto iterator = std::find(names.begin(), names.end(), name);
+        if (iterator == names.end())
+        {
+            names.push_back(name);
+            ticks.push_back(now - last);
+        }
+        else ticks[iterator - names.begin()] += now - last;
+        last = now;
+    }
+
+    int64 stage_timer::count() const
+    {
+        return frames;
+    }
+
+    std::string stage_timer::report() const
+    {
+        std::string report;
+        for (int i = 0; i < names.size(); i++)
+        {
+            const double ms = static_cast<double>(ticks[i]) / cv::getTickFrequency() * 1000.0 /
+                static_cast<double>(std::max(frames, static_cast<int64>(1)));
+            report += (i == 0 ? "" : ", ") + names[i] + ": " + cv::format("%.3f", ms) + "ms";
+        }
+        return report;
+    }
+
+    void stage_timer::reset()
+    {
+        names.clear();
+        ticks.clear();
+        frames = 0;
+    }
+
     void draw_armours(const std::vector<armour>& input, cv::Mat& output, const int index)
     {
         if (input.empty()) return;
@@ -91,4 +134,13 @@ namespace rm::debug
         if (!negative.empty())
             drawContours(output, negative, -1, {0, 255, 255}, 1);
     }
+
+    void draw_lightblobs(const std::vector<lightblob>& positive, const std::vector<blob_stats>& negative,
+                         cv::Mat& output, const int index)
+    {
+        draw_lightblobs(positive, std::vector<contour>(), output, index);
+
+        for (auto& blob : negative)
+            rectangle(output, blob.bounding_box, {0, 255, 255}, 1);
+    }
 }
@@ -4,6 +4,561 @@
 
 #include "imgproc.h"
 
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace
+{
+    /// Binarize one interleaved BGR row on the saturated difference of two channels.
+    /// \param bgr         Source row.
+    /// \param dst         Destine row.
+    /// \param cols        Pixel count of the row.
+    /// \param positive    Channel index of the minuend.
+    /// \param negative    Channel index of the subtrahend.
+    /// \param lower_bound Lower bound when performing binarization (clamped to [0, 255]).
+    void threshold_row(const uchar* bgr, uchar* dst, const int cols, const int positive, const int negative,
+                       const uchar lower_bound)
+    {
+        int x = 0;
+#if CV_SIMD
+        const auto bound = cv::vx_setall_u8(lower_bound);
+        const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+        for (; x <= cols - lanes; x += lanes)
+        {
+            cv::v_uint8 channels[3];
+            cv::v_load_deinterleave(bgr + x * 3, channels[0], channels[1], channels[2]);
+            cv::v_store(dst + x, cv::v_ge(cv::v_sub(channels[positive], channels[negative]), bound));
+        }
+#endif
+        for (; x < cols; x++)
+        {
+            const int difference = std::max(bgr[x * 3 + positive] - bgr[x * 3 + negative], 0);
+            dst[x] = difference >= lower_bound ? 255 : 0;
+        }
+    }
+
+    /// Binarize two raw Bayer rows at half resolution on the saturated difference of two samples of each 2x2 cell.
+    /// Samples are indexed 0 to 3 as top-left, top-right, bottom-left and bottom-right of the cell, a negative
+    /// subtrahend index averages both green samples into the minuend instead.
+    /// \param top         Even raw row.
+    /// \param bottom      Odd raw row.
+    /// \param dst         Destine row.
+    /// \param cols        Pixel count of the destine row.
+    /// \param positive    Sample index of the minuend (or the first green sample).
+    /// \param green       Sample index of the second green sample, only used when averaging.
+    /// \param negative    Sample index of the subtrahend.
+    /// \param average     Average positive and green samples as minuend.
+    /// \param lower_bound Lower bound when performing binarization (clamped to [0, 255]).
+    void threshold_bayer_row(const uchar* top, const uchar* bottom, uchar* dst, const int cols, const int positive,
+                             const int green, const int negative, const bool average, const uchar lower_bound)
+    {
+        int x = 0;
+#if CV_SIMD
+        const auto bound = cv::vx_setall_u8(lower_bound);
+        const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+        for (; x <= cols - lanes; x += lanes)
+        {
+            cv::v_uint8 samples[4];
+            cv::v_load_deinterleave(top + x * 2, samples[0], samples[1]);
+            cv::v_load_deinterleave(bottom + x * 2, samples[2], samples[3]);
+            const auto minuend = average ? cv::v_avg(samples[positive], samples[green]) : samples[positive];
+            cv::v_store(dst + x, cv::v_ge(cv::v_sub(minuend, samples[negative]), bound));
+        }
+#endif
+        for (; x < cols; x++)
+        {
+            const uchar samples[4] = {top[x * 2], top[x * 2 + 1], bottom[x * 2], bottom[x * 2 + 1]};
+            const int minuend = average ? (samples[positive] + samples[green] + 1) >> 1 : samples[positive];
+            dst[x] = std::max(minuend - samples[negative], 0) >= lower_bound ? 255 : 0;
+        }
+    }
+
+    /// Maximum of each pixel with its left and right neighbours. Source must be readable at [-1, cols].
+    void horizontal_max(const uchar* src, uchar* dst, const int cols)
+    {
+        int x = 0;
+#if CV_SIMD
+        const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+        for (; x <= cols - lanes; x += lanes)
+            cv::v_store(dst + x, cv::v_max(cv::v_max(cv::vx_load(src + x - 1), cv::vx_load(src + x)),
+                                           cv::vx_load(src + x + 1)));
+#endif
+        for (; x < cols; x++) dst[x] = std::max(std::max(src[x - 1], src[x]), src[x + 1]);
+    }
+
+    /// Minimum of each pixel with its left and right neighbours. Source must be readable at [-1, cols].
+    void horizontal_min(const uchar* src, uchar* dst, const int cols)
+    {
+        int x = 0;
+#if CV_SIMD
+        const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+        for (; x <= cols - lanes; x += lanes)
+            cv::v_store(dst + x, cv::v_min(cv::v_min(cv::vx_load(src + x - 1), cv::vx_load(src + x)),
+                                           cv::vx_load(src + x + 1)));
+#endif
+        for (; x < cols; x++) dst[x] = std::min(std::min(src[x - 1], src[x]), src[x + 1]);
+    }
+
+    void vertical_max(const uchar* up, const uchar* row, const uchar* down, uchar* dst, const int cols)
+    {
+        int x = 0;
+#if CV_SIMD
+        const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+        for (; x <= cols - lanes; x += lanes)
+            cv::v_store(dst + x, cv::v_max(cv::v_max(cv::vx_load(up + x), cv::vx_load(row + x)),
+                                           cv::vx_load(down + x)));
+#endif
+        for (; x < cols; x++) dst[x] = std::max(std::max(up[x], row[x]), down[x]);
+    }
+
+    void vertical_min(const uchar* up, const uchar* row, const uchar* down, uchar* dst, const int cols)
+    {
+        int x = 0;
+#if CV_SIMD
+        const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+        for (; x <= cols - lanes; x += lanes)
+            cv::v_store(dst + x, cv::v_min(cv::v_min(cv::vx_load(up + x), cv::vx_load(row + x)),
+                                           cv::vx_load(down + x)));
+#endif
+        for (; x < cols; x++) dst[x] = std::min(std::min(up[x], row[x]), down[x]);
+    }
+
+    /// Threshold rows with the given function and apply a 3x3 MORPH_CLOSE on the fly, writing rows
+    /// [row_begin, row_end) of the binary image. Pixels outside of the image are ignored, which matches
+    /// cv::morphologyEx with its default border. Each source row is thresholded once, only 6 rows of
+    /// intermediate results are kept alive.
+    /// \param binary    Destine image, already allocated as CV_8UC1.
+    /// \param threshold Function binarizing row y of the source into a row of binary.cols pixels.
+    /// \param buffer    Scratch memory of at least 8 * (binary.cols + 2) bytes.
+    template <typename RowFunction>
+    void close_rows(cv::Mat& binary, const int row_begin, const int row_end, RowFunction threshold, uchar* buffer)
+    {
+        const int rows = binary.rows, cols = binary.cols, stride = cols + 2;
+
+        // padded rows: thresholded rows are dilated so the border is 0, dilated rows are eroded so the border is 255
+        uchar* thresholded = buffer + 1;
+        uchar* dilated = thresholded + stride;
+        uchar* dilated_h[3] = {dilated + stride, dilated + stride * 2, dilated + stride * 3};
+        uchar* eroded_h[3] = {dilated + stride * 4, dilated + stride * 5, dilated + stride * 6};
+        thresholded[-1] = thresholded[cols] = 0;
+        dilated[-1] = dilated[cols] = 255;
+
+        // row i is thresholded, row i - 1 is dilated and row i - 2 is eroded in the same iteration
+        const int first = std::max(row_begin - 2, 0), last = std::min(row_end + 1, rows - 1);
+        for (int i = first; i <= row_end + 1; i++)
+        {
+            if (i <= last)
+            {
+                threshold(i, thresholded);
+                horizontal_max(thresholded, dilated_h[i % 3], cols);
+            }
+
+            if (const int j = i - 1;
+                j >= std::max(row_begin - 1, 0) && j <= std::min(row_end, rows - 1))
+            {
+                vertical_max(dilated_h[(j > 0 ? j - 1 : j) % 3], dilated_h[j % 3],
+                             dilated_h[(j < rows - 1 ? j + 1 : j) % 3], dilated, cols);
+                horizontal_min(dilated, eroded_h[j % 3], cols);
+            }
+
+            if (const int k = i - 2;
+                k >= row_begin && k < row_end)
+            {
+                vertical_min(eroded_h[(k > 0 ? k - 1 : k) % 3], eroded_h[k % 3],
+                             eroded_h[(k < rows - 1 ? k + 1 : k) % 3], binary.ptr(k), cols);
+            }
+        }
+    }
+
+    /// Number of stripes actually used for the given request.
+    int stripe_count(const int stripes, const int rows)
+    {
+        return std::clamp(stripes, 1, std::max(rows, 1));
+    }
+
+    /// Run close_rows over horizontal stripes in parallel, each stripe using its own slice of the scratch memory.
+    /// Every stripe re-thresholds the 2 rows around its seams, so the mask does not depend on the stripe count.
+    /// \param threshold Function (y, dst, stripe) binarizing row y, stripe is the index of the calling stripe when
+    ///                  the row belongs to it and -1 when it is only a seam row of a neighbour.
+    template <typename RowFunction>
+    void close_stripes(cv::Mat& binary, const int stripes, RowFunction threshold, std::vector<uchar>& buffer)
+    {
+        const int count = stripe_count(stripes, binary.rows);
+        const size_t size = 8 * (binary.cols + 2);
+        if (buffer.size() < size * count) buffer.resize(size * count);
+
+        const auto close_stripe = [&](const cv::Range& range)
+        {
+            for (int stripe = range.start; stripe < range.end; stripe++)
+            {
+                const int begin = binary.rows * stripe / count, end = binary.rows * (stripe + 1) / count;
+                close_rows(binary, begin, end, [&](const int y, uchar* dst)
+                {
+                    threshold(y, dst, y >= begin && y < end ? stripe : -1);
+                }, buffer.data() + size * stripe);
+            }
+        };
+
+        // the lambda overload of parallel_for_ wraps the body in a std::function, skip it for a single stripe
+        if (count == 1) close_stripe(cv::Range(0, 1));
+        else parallel_for_(cv::Range(0, count), close_stripe, count);
+    }
+
+    /// Accumulate the saturated channel difference of every other pixel of a BGR row into a coarse histogram.
+    void accumulate_row(const uchar* bgr, const int cols, const int positive, const int negative,
+                        rm::adaptive_threshold::histogram& histogram)
+    {
+        for (int x = 0; x < cols; x += 2)
+        {
+            const int difference = std::max(bgr[x * 3 + positive] - bgr[x * 3 + negative], 0);
+            histogram[difference * rm::adaptive_threshold::bins / 256]++;
+        }
+    }
+
+    /// Accumulate the saturated sample difference of every other cell of two Bayer rows into a coarse histogram, see
+    /// threshold_bayer_row for the sample indices.
+    void accumulate_bayer_row(const uchar* top, const uchar* bottom, const int cols, const int positive,
+                              const int green, const int negative, const bool average,
+                              rm::adaptive_threshold::histogram& histogram)
+    {
+        for (int x = 0; x < cols; x += 2)
+        {
+            const uchar samples[4] = {top[x * 2], top[x * 2 + 1], bottom[x * 2], bottom[x * 2 + 1]};
+            const int minuend = average ? (samples[positive] + samples[green] + 1) >> 1 : samples[positive];
+            histogram[std::max(minuend - samples[negative], 0) * rm::adaptive_threshold::bins / 256]++;
+        }
+    }
+
+    /// Update the threshold with the sum of the histograms of all stripes or windows.
+    void update_threshold(rm::adaptive_threshold& threshold,
+                          const std::vector<rm::adaptive_threshold::histogram>& histograms)
+    {
+        rm::adaptive_threshold::histogram histogram{};
+        for (const auto& part : histograms)
+        {
+            for (int i = 0; i < rm::adaptive_threshold::bins; i++) histogram[i] += part[i];
+        }
+        threshold.update(histogram);
+    }
+
+    int find_root(std::vector<int>& parent, int label)
+    {
+        while (parent[label] != label)
+        {
+            parent[label] = parent[parent[label]];
+            label = parent[label];
+        }
+        return label;
+    }
+
+    /// Statistics of a single run.
+    rm::blob_stats run_stats(const int y, const int x0, const int x1)
+    {
+        const auto square_sum = [](const double k) { return k * (k + 1) * (2 * k + 1) / 6; };
+        const int count = x1 - x0 + 1;
+        const double sum_x = static_cast<double>(x0 + x1) * count / 2;
+
+        rm::blob_stats stats;
+        stats.area = count;
+        stats.bounding_box = {x0, y, count, 1};
+        stats.sum_x = sum_x;
+        stats.sum_y = static_cast<double>(y) * count;
+        stats.sum_xx = square_sum(x1) - square_sum(x0 - 1);
+        stats.sum_xy = sum_x * y;
+        stats.sum_yy = static_cast<double>(y) * y * count;
+        return stats;
+    }
+
+    /// Label the runs of rows [row_begin, row_end) with provisional labels local to the stripe, a label is shared by
+    /// the 8-connected runs of adjacent rows and the smallest label of a component is its root.
+    void label_rows(const cv::Mat& binary, const int row_begin, const int row_end,
+                    rm::preprocess_workspace::stripe_labels& labels)
+    {
+        auto& runs = labels.runs;
+        auto& parent = labels.parent;
+        auto& stats = labels.provisional;
+        runs.clear();
+        parent.clear();
+        stats.clear();
+        labels.first_row_end = labels.last_row_begin = 0;
+
+        const int cols = binary.cols;
+        size_t previous_begin = 0, previous_end = 0;
+        for (int y = row_begin; y < row_end; y++)
+        {
+            if (y == row_end - 1) labels.last_row_begin = runs.size();
+
+            const uchar* row = binary.ptr(y);
+            size_t previous = previous_begin;
+            for (int x = 0; x < cols;)
+            {
+#if CV_SIMD
+                // skip empty blocks
+                const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+                const auto zero = cv::vx_setzero_u8();
+                while (x <= cols - lanes && !cv::v_check_any(cv::v_ne(cv::vx_load(row + x), zero))) x += lanes;
+#endif
+                while (x < cols && row[x] == 0) x++;
+                if (x == cols) break;
+
+                const int x0 = x;
+                while (x < cols && row[x] != 0) x++;
+                const int x1 = x - 1;
+
+                // 8-connected runs of the previous row overlap [x0 - 1, x1 + 1]
+                while (previous < previous_end && runs[previous].x1 < x0 - 1) previous++;
+
+                int label = -1;
+                for (size_t i = previous; i < previous_end && runs[i].x0 <= x1 + 1; i++)
+                {
+                    const int root = find_root(parent, runs[i].label);
+                    if (label < 0) label = root;
+                    else if (root != label)
+                    {
+                        parent[std::max(root, label)] = std::min(root, label);
+                        label = std::min(root, label);
+                    }
+                }
+
+                if (label < 0)
+                {
+                    label = static_cast<int>(parent.size());
+                    parent.push_back(label);
+                    stats.emplace_back();
+                }
+
+                stats[label].merge(run_stats(y, x0, x1));
+                runs.push_back({x0, x1, label});
+            }
+
+            previous_begin = previous_end;
+            previous_end = runs.size();
+            if (y == row_begin) labels.first_row_end = runs.size();
+        }
+    }
+
+    /// Union the labels of the 8-connected runs of two adjacent rows, each row sorted by x. Labels of the runs are
+    /// local to their stripe and shifted by the offset of the stripe in the global forest.
+    void merge_seam(const rm::preprocess_workspace::run* upper, const rm::preprocess_workspace::run* upper_end,
+                    const int upper_offset, const rm::preprocess_workspace::run* lower,
+                    const rm::preprocess_workspace::run* lower_end, const int lower_offset, std::vector<int>& parent)
+    {
+        for (; lower != lower_end; ++lower)
+        {
+            while (upper != upper_end && upper->x1 < lower->x0 - 1) ++upper;
+            for (auto* run = upper; run != upper_end && run->x0 <= lower->x1 + 1; ++run)
+            {
+                const int a = find_root(parent, upper_offset + run->label);
+                const int b = find_root(parent, lower_offset + lower->label);
+                if (a != b) parent[std::max(a, b)] = std::min(a, b);
+            }
+        }
+    }
+
+    /// Fused color binarization, see rm::binarize_color.
+    /// \param histograms One histogram per stripe receiving the differences of every row_stride-th row, or null.
+    void binarize_color_buffered(const cv::Mat& source, cv::Mat& binary, const rm::camp target,
+                                 const int lower_bound, const int stripes, std::vector<uchar>& buffer,
+                                 rm::adaptive_threshold::histogram* histograms = nullptr, const int row_stride = 1)
+    {
+        if (source.type() != CV_8UC3)
+        {
+            binary.release();
+            return;
+        }
+
+        binary.create(source.size(), CV_8UC1);
+        if (lower_bound > 255)
+        {
+            binary.setTo(0);
+            return;
+        }
+
+        const int positive = target == rm::CAMP_GUIDELIGHT ? 1 : target == rm::CAMP_BLUE ? 0 : 2;
+        const int negative = target == rm::CAMP_GUIDELIGHT ? 2 : target == rm::CAMP_BLUE ? 2 : 0;
+        const auto bound = static_cast<uchar>(std::max(lower_bound, 0));
+
+        close_stripes(binary, stripes, [&](const int y, uchar* dst, const int stripe)
+        {
+            threshold_row(source.ptr(y), dst, source.cols, positive, negative, bound);
+            if (histograms && stripe >= 0 && y % row_stride == 0)
+                accumulate_row(source.ptr(y), source.cols, positive, negative, histograms[stripe]);
+        }, buffer);
+    }
+
+    /// Half resolution Bayer binarization, see rm::binarize_bayer.
+    /// \param histograms One histogram per stripe receiving the differences of every row_stride-th row, or null.
+    void binarize_bayer_buffered(const cv::Mat& raw, cv::Mat& binary, const rm::BayerPattern pattern,
+                                 const rm::camp target, const int lower_bound, const int stripes,
+                                 std::vector<uchar>& buffer, rm::adaptive_threshold::histogram* histograms = nullptr,
+                                 const int row_stride = 1)
+    {
+        if (raw.type() != CV_8UC1)
+        {
+            binary.release();
+            return;
+        }
+
+        binary.create(raw.rows / 2, raw.cols / 2, CV_8UC1);
+        if (lower_bound > 255)
+        {
+            binary.setTo(0);
+            return;
+        }
+
+        // sample index of each color inside the 2x2 cell
+        int red = 0, blue = 3, greens[2] = {1, 2};
+        switch (pattern)
+        {
+        case rm::BAYER_RG:
+            red = 0, blue = 3, greens[0] = 1, greens[1] = 2;
+            break;
+        case rm::BAYER_GB:
+            red = 2, blue = 1, greens[0] = 0, greens[1] = 3;
+            break;
+        case rm::BAYER_GR:
+            red = 1, blue = 2, greens[0] = 0, greens[1] = 3;
+            break;
+        case rm::BAYER_BG:
+            red = 3, blue = 0, greens[0] = 1, greens[1] = 2;
+            break;
+        }
+
+        const bool average = target == rm::CAMP_GUIDELIGHT;
+        const int positive = average ? greens[0] : target == rm::CAMP_BLUE ? blue : red;
+        const int negative = average ? red : target == rm::CAMP_BLUE ? red : blue;
+        const auto bound = static_cast<uchar>(std::max(lower_bound, 0));
+
+        close_stripes(binary, stripes, [&](const int y, uchar* dst, const int stripe)
+        {
+            threshold_bayer_row(raw.ptr(y * 2), raw.ptr(y * 2 + 1), dst, binary.cols, positive, greens[1], negative,
+                                average, bound);
+            if (histograms && stripe >= 0 && y % row_stride == 0)
+            {
+                accumulate_bayer_row(raw.ptr(y * 2), raw.ptr(y * 2 + 1), binary.cols, positive, greens[1], negative,
+                                     average, histograms[stripe]);
+            }
+        }, buffer);
+    }
+
+    /// Gamma factor used by AutoEnhance for the given mean pixel value.
+    float enhance_gamma(const float meanC3, const float maxGainFactor, const float minGainFactor)
+    {
+        float k = 2.0f / (maxGainFactor - minGainFactor);
+        float b = 3.0f - maxGainFactor * k;
+        float gammaFactor = k * meanC3 + b;
+
+        // Map [1.0, -3.0] to [1.0, 0.0]
+        if (gammaFactor <= 1.0f && gammaFactor >= -3.0f)
+        {
+            gammaFactor = 1.0f + (gammaFactor - 1) / 4.0f;
+        }
+        else if (gammaFactor < -3.0f)
+        {
+            // Frame too dark, gamma might not helpful in this case.
+            gammaFactor = 0;
+        }
+
+        return gammaFactor;
+    }
+
+    /// Clip search windows to the frame and merge the overlapping ones in place, so that no pixel is scanned twice.
+    void merge_windows(std::vector<cv::Rect>& merged, const cv::Rect& frame)
+    {
+        for (auto& window : merged) window &= frame;
+        merged.erase(std::remove_if(merged.begin(), merged.end(), [](const cv::Rect& window)
+        {
+            return window.empty();
+        }), merged.end());
+
+        for (bool overlapped = true; overlapped;)
+        {
+            overlapped = false;
+            for (size_t i = 0; i < merged.size() && !overlapped; i++)
+            {
+                for (size_t j = i + 1; j < merged.size(); j++)
+                {
+                    if ((merged[i] & merged[j]).empty()) continue;
+
+                    merged[i] |= merged[j];
+                    merged.erase(merged.begin() + j);
+                    overlapped = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    /// Round search windows at full resolution outwards to whole cells of a Bayer frame, so that every window starts
+    /// on an even raw pixel and keeps the Bayer pattern of the frame.
+    /// \param windows  Search windows at full resolution.
+    /// \param raw_size Size of the raw frame.
+    /// \param cells    Output windows at half resolution, clipped to the frame and merged when overlapping.
+    void bayer_cells(const std::vector<cv::Rect>& windows, const cv::Size raw_size, std::vector<cv::Rect>& cells)
+    {
+        cells.clear();
+        for (const auto& window : windows)
+        {
+            if (const auto clipped = window & cv::Rect(0, 0, raw_size.width, raw_size.height);
+                !clipped.empty())
+            {
+                const int x0 = clipped.x / 2, y0 = clipped.y / 2;
+                cells.emplace_back(x0, y0, (clipped.br().x + 1) / 2 - x0, (clipped.br().y + 1) / 2 - y0);
+            }
+        }
+        merge_windows(cells, {0, 0, raw_size.width / 2, raw_size.height / 2});
+    }
+
+    /// Windowed color binarization into the workspace, see rm::binarize_color.
+    /// \param histogram Histogram receiving the differences of every row_stride-th row of each window, or null.
+    void binarize_color_windows(const cv::Mat& source, const rm::camp target, const int lower_bound,
+                                const std::vector<cv::Rect>& windows, rm::preprocess_workspace& workspace,
+                                rm::adaptive_threshold::histogram* histogram = nullptr, const int row_stride = 1)
+    {
+        if (source.type() != CV_8UC3)
+        {
+            workspace.binary.release();
+            return;
+        }
+
+        workspace.binary.create(source.size(), CV_8UC1);
+        workspace.binary.setTo(0);
+        workspace.windows.assign(windows.begin(), windows.end());
+        merge_windows(workspace.windows, {0, 0, source.cols, source.rows});
+
+        for (const auto& window : workspace.windows)
+        {
+            cv::Mat roi = workspace.binary(window);
+            binarize_color_buffered(source(window), roi, target, lower_bound, 1, workspace.rows, histogram,
+                                    row_stride);
+        }
+    }
+
+    /// Windowed half resolution Bayer binarization into the workspace, see rm::binarize_bayer.
+    /// \param histogram Histogram receiving the differences of every row_stride-th row of each window, or null.
+    void binarize_bayer_windows(const cv::Mat& raw, const rm::BayerPattern pattern, const rm::camp target,
+                                const int lower_bound, const std::vector<cv::Rect>& windows,
+                                rm::preprocess_workspace& workspace,
+                                rm::adaptive_threshold::histogram* histogram = nullptr, const int row_stride = 1)
+    {
+        if (raw.type() != CV_8UC1)
+        {
+            workspace.binary.release();
+            return;
+        }
+
+        workspace.binary.create(raw.rows / 2, raw.cols / 2, CV_8UC1);
+        workspace.binary.setTo(0);
+        bayer_cells(windows, raw.size(), workspace.windows);
+
+        for (const auto& cell : workspace.windows)
+        {
+            cv::Mat roi = workspace.binary(cell);
+            binarize_bayer_buffered(raw({cell.x * 2, cell.y * 2, cell.width * 2, cell.height * 2}), roi, pattern,
+                                    target, lower_bound, 1, workspace.rows, histogram, row_stride);
+        }
+    }
+}
+
 namespace rm
 {
     cv::Mat affine_correction(const cv::Mat& source, cv::Point2f vertices[4], const cv::Size outSize)
@@ -34,6 +589,61 @@ namespace rm
         return calibration;
     }
 
+    void rectify_icons(const cv::Mat& source, const std::vector<armour>& armours, cv::Mat& features,
+                       const cv::Size icon_size)
+    {
+        // only 8 bit frames are sampled, other depths leave no rows to classify
+        if (source.depth() != CV_8U)
+        {
+            features.release();
+            return;
+        }
+
+        const int channels = source.channels();
+        features.create(static_cast<int>(armours.size()), icon_size.area() * channels, CV_32F);
+        if (armours.empty()) return;
+
+        const float max_x = static_cast<float>(source.cols) - 1, max_y = static_cast<float>(source.rows) - 1;
+        for (int i = 0; i < armours.size(); i++)
+        {
+            cv::Point2f vertices[4];
+            for (int j = 0; j < 4; j++)
+            {
+                vertices[j].x = std::max(0.0f, std::min(armours[i].icon[j].x, max_x));
+                vertices[j].y = std::max(0.0f, std::min(armours[i].icon[j].y, max_y));
+            }
+
+            // left up vertex to origin, right up vertex along the width, left down vertex along the height
+            const cv::Point2f step_u = (vertices[2] - vertices[1]) / static_cast<float>(icon_size.width);
+            const cv::Point2f step_v = (vertices[0] - vertices[1]) / static_cast<float>(icon_size.height);
+
+            auto* row = features.ptr<float>(i);
+            for (int v = 0; v < icon_size.height; v++)
+            {
+                for (int u = 0; u < icon_size.width; u++)
+                {
+                    // sample at the center of the destine pixel, clamped to the frame
+                    const cv::Point2f point = vertices[1] + step_u * (u + 0.5f) + step_v * (v + 0.5f);
+                    const float x = std::max(0.0f, std::min(point.x, max_x));
+                    const float y = std::max(0.0f, std::min(point.y, max_y));
+
+                    const int x0 = static_cast<int>(x), y0 = static_cast<int>(y);
+                    const int x1 = std::min(x0 + 1, source.cols - 1), y1 = std::min(y0 + 1, source.rows - 1);
+                    const float fx = x - static_cast<float>(x0), fy = y - static_cast<float>(y0);
+
+                    const uchar* top = source.ptr(y0);
+                    const uchar* bottom = source.ptr(y1);
+                    for (int c = 0; c < channels; c++)
+                    {
+                        const float upper = top[x0 * channels + c] * (1 - fx) + top[x1 * channels + c] * fx;
+                        const float lower = bottom[x0 * channels + c] * (1 - fx) + bottom[x1 * channels + c] * fx;
+                        *row++ = upper * (1 - fy) + lower * fy;
+                    }
+                }
+            }
+        }
+    }
+
     void CalcGamma(cv::Mat& source, cv::Mat& calibration, float gamma)
     {
         cv::Mat lookUpTable(1, 256, CV_8U);
@@ -47,6 +657,100 @@ namespace rm
         cv::LUT(source, lookUpTable, calibration);
     }
 
+    void CalcGamma(cv::Mat& source, cv::Mat& calibration, const float gamma, preprocess_workspace& workspace)
+    {
+        cv::LUT(source, workspace.gamma.table(gamma), calibration);
+    }
+
+    gamma_engine::gamma_engine(const int stride) :
+        tables(static_cast<size_t>(steps * gamma_max) + 1), stride(std::max(stride, 1))
+    {
+    }
+
+    const cv::Mat& gamma_engine::table(const float gamma)
+    {
+        CV_Assert(std::isfinite(gamma));
+
+        // tables is sized for every index up front, so that returned references are never invalidated
+        const auto index = static_cast<size_t>(std::lround(std::clamp(gamma, 0.0f, gamma_max) * steps));
+
+        cv::Mat& lookUpTable = tables[index];
+        if (lookUpTable.empty())
+        {
+            lookUpTable.create(1, 256, CV_8U);
+            uchar* p = lookUpTable.ptr();
+            for (int i = 0; i < 256; ++i)
+            {
+                p[i] = cv::saturate_cast<uchar>(pow(i / 255.0, static_cast<double>(index) / steps) * 255.0);
+            }
+        }
+
+        return lookUpTable;
+    }
+
+    void gamma_engine::apply(cv::Mat& frame, const float gamma)
+    {
+        // cv::LUT is vectorised and runs in place
+        cv::LUT(frame, table(gamma), frame);
+    }
+
+    float gamma_engine::brightness(const cv::Mat& frame) const
+    {
+        if (frame.empty() || frame.depth() != CV_8U) return 0;
+
+        const int channels = frame.channels();
+        uint64_t sum = 0, count = 0;
+        for (int y = 0; y < frame.rows; y += stride)
+        {
+            const uchar* row = frame.ptr(y);
+            for (int x = 0; x < frame.cols; x += stride)
+            {
+                for (int c = 0; c < channels; c++) sum += row[x * channels + c];
+            }
+            count += (frame.cols + stride - 1) / stride;
+        }
+
+        return static_cast<float>(sum) / static_cast<float>(count * channels);
+    }
+
+    color_integral::color_integral(const cv::Mat& source, const int scale)
+    {
+        compute(source, scale);
+    }
+
+    void color_integral::compute(const cv::Mat& source, const int scale)
+    {
+        CV_Assert(source.type() == CV_8UC3);
+
+        // 255 * 2^23 pixels still fit a 32 bit sum
+        this->scale = std::max(scale, 1);
+        if (this->scale > 1)
+        {
+            resize(source, reduced, {source.cols / this->scale, source.rows / this->scale}, 0, 0, cv::INTER_AREA);
+            integral(reduced, sums, CV_32S);
+        }
+        else
+        {
+            integral(source, sums, CV_32S);
+        }
+    }
+
+    cv::Scalar color_integral::mean(const cv::Rect& rect) const
+    {
+        if (sums.empty()) return {};
+
+        const int x0 = std::clamp(rect.x / scale, 0, sums.cols - 1);
+        const int y0 = std::clamp(rect.y / scale, 0, sums.rows - 1);
+        const int x1 = std::clamp((rect.x + rect.width + scale - 1) / scale, 0, sums.cols - 1);
+        const int y1 = std::clamp((rect.y + rect.height + scale - 1) / scale, 0, sums.rows - 1);
+        if (x1 <= x0 || y1 <= y0) return {};
+
+        const cv::Vec3i sum = sums.at<cv::Vec3i>(y1, x1) - sums.at<cv::Vec3i>(y0, x1) -
+            sums.at<cv::Vec3i>(y1, x0) + sums.at<cv::Vec3i>(y0, x0);
+        const double area = (x1 - x0) * (y1 - y0);
+        return {sum[0] / area, sum[1] / area, sum[2] / area};
+    }
+
     std::tuple<std::vector<contour>, cv::Mat> extract_color(cv::InputArray image, camp target, int lower_bound)
     {
         std::vector<cv::Mat> channels;
@@ -74,27 +778,325 @@ namespace rm
         return {contours, binary};
     }
 
-    void AutoEnhance(cv::Mat& frame, float maxGainFactor, float minGainFactor)
+    std::tuple<std::vector<contour>, cv::Mat> extract_color(cv::InputArray image, const camp target,
+                                                            const int lower_bound, const std::vector<cv::Rect>& windows)
     {
-        cv::Scalar meanValue = cv::mean(frame);
-        float meanC3 = (float)(meanValue[0] + meanValue[1] + meanValue[2]) /
-            3.0f;
-        float k = 2.0f / (maxGainFactor - minGainFactor);
-        float b = 3.0f - maxGainFactor * k;
-        float gammaFactor = k * meanC3 + b;
+        const cv::Mat source = image.getMat();
+        cv::Mat binary = cv::Mat::zeros(source.size(), CV_8UC1);
 
-        // Map [1.0, -3.0] to [1.0, 0.0]
-        if (gammaFactor <= 1.0f && gammaFactor >= -3.0f)
+        std::vector<cv::Rect> merged(windows);
+        merge_windows(merged, {0, 0, source.cols, source.rows});
+
+        std::vector<contour> contours;
+        for (const auto& window : merged)
         {
-            gammaFactor = 1.0f + (gammaFactor - 1) / 4.0f;
+            cv::Mat roi = binary(window);
+            binarize_color(source(window), roi, target, lower_bound);
+
+            std::vector<contour> window_contours;
+            findContours(roi, window_contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE, window.tl());
+            contours.insert(contours.end(), window_contours.begin(), window_contours.end());
         }
-        else if (gammaFactor < -3.0f)
+
+        return {contours, binary};
+    }
+
+    void extract_color(cv::InputArray image, const camp target, const int lower_bound,
+                       preprocess_workspace& workspace, const int stripes)
+    {
+        binarize_color(image, target, lower_bound, workspace, stripes);
+
+        if (workspace.binary.empty()) workspace.contours.clear();
+        else findContours(workspace.binary, workspace.contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+    }
+
+    void binarize_color(cv::InputArray image, cv::Mat& binary, const camp target, const int lower_bound,
+                        const int stripes)
+    {
+        // row buffers are kept per calling thread, so that repeated calls do not allocate
+        thread_local std::vector<uchar> buffer;
+        binarize_color_buffered(image.getMat(), binary, target, lower_bound, stripes, buffer);
+    }
+
+    void binarize_color(cv::InputArray image, const camp target, const int lower_bound,
+                        preprocess_workspace& workspace, const int stripes)
+    {
+        binarize_color_buffered(image.getMat(), workspace.binary, target, lower_bound, stripes, workspace.rows);
+    }
+
+    void binarize_color(cv::InputArray image, const camp target, const int lower_bound,
+                        const std::vector<cv::Rect>& windows, preprocess_workspace& workspace)
+    {
+        binarize_color_windows(image.getMat(), target, lower_bound, windows, workspace);
+    }
+
+    void binarize_color(cv::InputArray image, const camp target, adaptive_threshold& threshold,
+                        const std::vector<cv::Rect>& windows, preprocess_workspace& workspace)
+    {
+        workspace.histograms.assign(1, {});
+        binarize_color_windows(image.getMat(), target, threshold.value(), windows, workspace,
+                               workspace.histograms.data(), threshold.stride());
+        update_threshold(threshold, workspace.histograms);
+    }
+
+    void binarize_color(cv::InputArray image, const camp target, adaptive_threshold& threshold,
+                        preprocess_workspace& workspace, const int stripes)
+    {
+        const cv::Mat source = image.getMat();
+        const int count = stripe_count(stripes, source.rows);
+        workspace.histograms.assign(count, {});
+
+        binarize_color_buffered(source, workspace.binary, target, threshold.value(), count, workspace.rows,
+                                workspace.histograms.data(), threshold.stride());
+        update_threshold(threshold, workspace.histograms);
+    }
+
+    adaptive_threshold::adaptive_threshold(const int initial, const range<int> limits, const float smoothing,
+                                           const int row_stride) :
+        current(static_cast<float>(initial)), limits(limits), smoothing(smoothing),
+        row_stride(std::max(row_stride, 1))
+    {
+    }
+
+    int adaptive_threshold::value() const
+    {
+        return static_cast<int>(std::lround(current));
+    }
+
+    int adaptive_threshold::stride() const
+    {
+        return row_stride;
+    }
+
+    void adaptive_threshold::update(const histogram& counts)
+    {
+        // Otsu's method on the coarse histogram
+        double total = 0, sum = 0;
+        for (int i = 0; i < bins; i++)
         {
-            // Frame too dark, gamma might not helpful in this case.
-            gammaFactor = 0;
+            total += counts[i];
+            sum += static_cast<double>(i) * counts[i];
         }
+        if (total == 0) return;
 
-        rm::CalcGamma(frame, frame, gammaFactor);
+        double weight_background = 0, sum_background = 0, variance_max = -1;
+        int split = 0;
+        for (int i = 0; i < bins - 1; i++)
+        {
+            weight_background += counts[i];
+            sum_background += static_cast<double>(i) * counts[i];
+            const double weight_foreground = total - weight_background;
+            if (weight_background == 0) continue;
+            if (weight_foreground == 0) break;
+
+            const double mean_difference = sum_background / weight_background -
+                (sum - sum_background) / weight_foreground;
+            if (const double variance = weight_background * weight_foreground * mean_difference * mean_difference;
+                variance > variance_max)
+            {
+                variance_max = variance;
+                split = i;
+            }
+        }
+
+        // threshold at the upper edge of the background bins, smoothed over time
+        const int target = std::clamp((split + 1) * (256 / bins), limits.lower_bound, limits.upper_bound);
+        current += smoothing * (static_cast<float>(target) - current);
+    }
+
+    void binarize_bayer(const cv::Mat& raw, cv::Mat& binary, const BayerPattern pattern, const camp target,
+                        const int lower_bound, const int stripes)
+    {
+        // row buffers are kept per calling thread, so that repeated calls do not allocate
+        thread_local std::vector<uchar> buffer;
+        binarize_bayer_buffered(raw, binary, pattern, target, lower_bound, stripes, buffer);
+    }
+
+    void binarize_bayer(const cv::Mat& raw, const BayerPattern pattern, const camp target, const int lower_bound,
+                        preprocess_workspace& workspace, const int stripes)
+    {
+        binarize_bayer_buffered(raw, workspace.binary, pattern, target, lower_bound, stripes, workspace.rows);
+    }
+
+    void binarize_bayer(const cv::Mat& raw, const BayerPattern pattern, const camp target,
+                        adaptive_threshold& threshold, preprocess_workspace& workspace, const int stripes)
+    {
+        const int count = stripe_count(stripes, raw.rows / 2);
+        workspace.histograms.assign(count, {});
+
+        binarize_bayer_buffered(raw, workspace.binary, pattern, target, threshold.value(), count, workspace.rows,
+                                workspace.histograms.data(), threshold.stride());
+        update_threshold(threshold, workspace.histograms);
+    }
+
+    void binarize_bayer(const cv::Mat& raw, const BayerPattern pattern, const camp target, const int lower_bound,
+                        const std::vector<cv::Rect>& windows, preprocess_workspace& workspace)
+    {
+        binarize_bayer_windows(raw, pattern, target, lower_bound, windows, workspace);
+    }
+
+    void binarize_bayer(const cv::Mat& raw, const BayerPattern pattern, const camp target,
+                        adaptive_threshold& threshold, const std::vector<cv::Rect>& windows,
+                        preprocess_workspace& workspace)
+    {
+        workspace.histograms.assign(1, {});
+        binarize_bayer_windows(raw, pattern, target, threshold.value(), windows, workspace,
+                               workspace.histograms.data(), threshold.stride());
+        update_threshold(threshold, workspace.histograms);
+    }
+
+    std::tuple<std::vector<contour>, cv::Mat> extract_color_bayer(const cv::Mat& raw, const BayerPattern pattern,
+                                                                  const camp target, const int lower_bound)
+    {
+        cv::Mat binary;
+        binarize_bayer(raw, binary, pattern, target, lower_bound);
+
+        std::vector<contour> contours;
+        if (binary.empty()) return {contours, binary};
+
+        findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+        for (auto& contour : contours)
+            for (auto& point : contour) point *= 2;
+
+        return {contours, binary};
+    }
+
+    std::tuple<std::vector<contour>, cv::Mat> extract_color_bayer(const cv::Mat& raw, const BayerPattern pattern,
+                                                                  const camp target, const int lower_bound,
+                                                                  const std::vector<cv::Rect>& windows)
+    {
+        std::vector<contour> contours;
+        if (raw.type() != CV_8UC1) return {contours, cv::Mat()};
+
+        cv::Mat binary = cv::Mat::zeros(raw.rows / 2, raw.cols / 2, CV_8UC1);
+        std::vector<cv::Rect> cells;
+        bayer_cells(windows, raw.size(), cells);
+
+        for (const auto& cell : cells)
+        {
+            cv::Mat roi = binary(cell);
+            binarize_bayer(raw({cell.x * 2, cell.y * 2, cell.width * 2, cell.height * 2}), roi, pattern, target,
+                           lower_bound);
+
+            std::vector<contour> window_contours;
+            findContours(roi, window_contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE, cell.tl());
+            for (auto& contour : window_contours)
+                for (auto& point : contour) point *= 2;
+            contours.insert(contours.end(), window_contours.begin(), window_contours.end());
+        }
+
+        return {contours, binary};
+    }
+
+    void extract_color_bayer(const cv::Mat& raw, const BayerPattern pattern, const camp target, const int lower_bound,
+                             preprocess_workspace& workspace, const int stripes)
+    {
+        binarize_bayer(raw, pattern, target, lower_bound, workspace, stripes);
+
+        workspace.contours.clear();
+        if (workspace.binary.empty()) return;
+
+        findContours(workspace.binary, workspace.contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+        for (auto& contour : workspace.contours)
+            for (auto& point : contour) point *= 2;
+    }
+
+    std::vector<blob_stats> label_blobs(const cv::Mat& binary)
+    {
+        preprocess_workspace workspace;
+        label_blobs(binary, workspace);
+        return workspace.blobs;
+    }
+
+    void label_blobs(const cv::Mat& binary, preprocess_workspace& workspace, const int stripes)
+    {
+        auto& parent = workspace.parent;
+        auto& stats = workspace.provisional;
+        auto& components = workspace.blobs;
+        parent.clear();
+        stats.clear();
+        components.clear();
+        if (binary.type() != CV_8UC1) return;
+
+        const int count = stripe_count(stripes, binary.rows);
+        auto& labels = workspace.labels;
+        if (labels.size() < static_cast<size_t>(count)) labels.resize(count);
+
+        const auto label_stripes = [&](const cv::Range& range)
+        {
+            for (int stripe = range.start; stripe < range.end; stripe++)
+                label_rows(binary, binary.rows * stripe / count, binary.rows * (stripe + 1) / count, labels[stripe]);
+        };
+        if (count == 1) label_stripes(cv::Range(0, 1));
+        else parallel_for_(cv::Range(0, count), label_stripes, count);
+
+        // concatenate the forests of the stripes in row order, then union the runs touching across each seam
+        for (int stripe = 0; stripe < count; stripe++)
+        {
+            auto& local = labels[stripe];
+            local.offset = static_cast<int>(parent.size());
+            for (int label = 0; label < static_cast<int>(local.parent.size()); label++)
+                parent.push_back(local.offset + find_root(local.parent, label));
+            stats.insert(stats.end(), local.provisional.begin(), local.provisional.end());
+        }
+        for (int stripe = 1; stripe < count; stripe++)
+        {
+            const auto& upper = labels[stripe - 1];
+            const auto& lower = labels[stripe];
+            merge_seam(upper.runs.data() + upper.last_row_begin, upper.runs.data() + upper.runs.size(), upper.offset,
+                       lower.runs.data(), lower.runs.data() + lower.first_row_end, lower.offset, parent);
+        }
+
+        // fold provisional labels into their roots, roots keep the raster order of their first pixel
+        for (int label = 0; label < static_cast<int>(parent.size()); label++)
+        {
+            if (const int root = find_root(parent, label);
+                root != label)
+                stats[root].merge(stats[label]);
+        }
+        for (int label = 0; label < static_cast<int>(parent.size()); label++)
+        {
+            if (parent[label] == label) components.push_back(stats[label]);
+        }
+    }
+
+    void demosaic(const cv::Mat& raw, cv::Mat& image, const BayerPattern pattern)
+    {
+        // OpenCV names Bayer patterns after the second row of the 2x2 cell
+        switch (pattern)
+        {
+        case BAYER_RG:
+            cvtColor(raw, image, cv::COLOR_BayerBG2BGR);
+            break;
+        case BAYER_GB:
+            cvtColor(raw, image, cv::COLOR_BayerGR2BGR);
+            break;
+        case BAYER_GR:
+            cvtColor(raw, image, cv::COLOR_BayerGB2BGR);
+            break;
+        case BAYER_BG:
+            cvtColor(raw, image, cv::COLOR_BayerRG2BGR);
+            break;
+        }
+    }
+
+    void AutoEnhance(cv::Mat& frame, float maxGainFactor, float minGainFactor)
+    {
+        cv::Scalar meanValue = cv::mean(frame);
+        float meanC3 = (float)(meanValue[0] + meanValue[1] + meanValue[2]) /
+            3.0f;
+
+        rm::CalcGamma(frame, frame, enhance_gamma(meanC3, maxGainFactor, minGainFactor));
+    }
+
+    void AutoEnhance(cv::Mat& frame, gamma_engine& engine, float maxGainFactor, float minGainFactor)
+    {
+        engine.apply(frame, enhance_gamma(engine.brightness(frame), maxGainFactor, minGainFactor));
+    }
+
+    void AutoEnhance(cv::Mat& frame, preprocess_workspace& workspace, float maxGainFactor, float minGainFactor)
+    {
+        AutoEnhance(frame, workspace.gamma, maxGainFactor, minGainFactor);
     }
 
     void AutoBinarize(cv::Mat& image, cv::Mat& binary)
@@ -107,4 +1109,15 @@ namespace rm
 
         binary.convertTo(binary, CV_32FC1, 1.0 / 255.0);
     }
+
+    void AutoBinarize(cv::Mat& image, cv::Mat& binary, preprocess_workspace& workspace)
+    {
+        cv::cvtColor(image, workspace.gray, cv::COLOR_BGR2GRAY);
+        cv::Scalar meanValue = cv::mean(workspace.gray);
+        cv::inRange(
+            workspace.gray, cv::Scalar{meanValue[0], meanValue[1], meanValue[2]},
+            cv::Scalar{255, 255, 255}, workspace.gray);
+
+        workspace.gray.convertTo(binary, CV_32FC1, 1.0 / 255.0);
+    }
 }
@@ -3,13 +3,64 @@
 //
 
 #include "objdetect.h"
+#include "detector.hpp"
+
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace
+{
+    /// Camp of a light blob from its mean color, green dominant blobs are guide lights.
+    rm::camp classify_color(const cv::Scalar& meanValue)
+    {
+        if (meanValue.val[1] > meanValue.val[0] && meanValue.val[1] > meanValue.val[2]) return rm::CAMP_GUIDELIGHT;
+        return meanValue.val[0] > meanValue.val[2] ? rm::CAMP_BLUE : rm::CAMP_RED;
+    }
+
+    /// Rows of the band searched for guide lights, empty when the image is not BGR or the band is empty.
+    cv::Range guidelight_rows(const cv::Mat& image, const rm::range<float> band)
+    {
+        if (image.type() != CV_8UC3) return {0, 0};
+
+        const int top = std::clamp(static_cast<int>(band.lower_bound * image.rows), 0, image.rows);
+        const int bottom = std::clamp(static_cast<int>(std::ceil(band.upper_bound * image.rows)), top, image.rows);
+        return {top, bottom};
+    }
+
+    /// Guide lights among the components labelled in the workspace, see rm::find_guidelights.
+    /// \param top Row of the band in the frame, added to the centers.
+    std::vector<rm::lightblob> fit_guidelights(const rm::preprocess_workspace& workspace, const int top,
+                                               const rm::range<double> area_range, const float circularity_min)
+    {
+        std::vector<rm::lightblob> guidelights;
+        for (auto& blob : workspace.blobs)
+        {
+            if (!area_range.contains(blob.area)) continue;
+
+            // a solid disc has equal axes and fills its equivalent ellipse
+            const cv::RotatedRect ellipse = blob.ellipse();
+            if (ellipse.size.height <= 0 || ellipse.size.width < circularity_min * ellipse.size.height) continue;
+            if (blob.area < circularity_min * CV_PI / 4 * ellipse.size.width * ellipse.size.height) continue;
+
+            guidelights.emplace_back(
+                cv::RotatedRect(ellipse.center + cv::Point2f(0, static_cast<float>(top)), ellipse.size,
+                                ellipse.angle), rm::CAMP_GUIDELIGHT);
+        }
+
+        std::sort(guidelights.begin(), guidelights.end(), [](const rm::lightblob& a, const rm::lightblob& b)
+        {
+            return a.size.area() > b.size.area();
+        });
+        return guidelights;
+    }
+}
 
 namespace rm
 {
     bool MatchLightBlob(const std::vector<cv::Point>& contour, float minRatio, float maxRatio, float tiltAngle,
                         float minArea, float maxArea, cv::RotatedRect& lightBlobBox, bool fitEllipse)
     {
-        if (contour.size() < 6 || cv::contourArea(contour) < minArea || cv::contourArea(contour) > maxArea)
+        if (contour.size() < 6) return false;
+        if (const double area = cv::contourArea(contour); area < minArea || area > maxArea)
             return false;
 
         cv::RotatedRect ellipse = cv::fitEllipseDirect(contour); // Calculate tilt angle using ellipse anyway
@@ -40,50 +91,140 @@ namespace rm
             if (!MatchLightBlob(contour, minRatio, maxRatio, tiltAngle, minArea, maxArea, box, fitEllipse))
                 continue;
 
-            cv::Scalar meanValue = mean(source(boundingRect(contour)));
-            if (meanValue.val[1] > meanValue.val[0] && meanValue.val[1] > meanValue.val[2])
-            {
-                lightBlobs.emplace_back(box, CAMP_GUIDELIGHT);
-            }
-            else
-            {
-                lightBlobs.emplace_back(box, meanValue.val[0] > meanValue.val[2] ? CAMP_BLUE : CAMP_RED);
-            }
+            lightBlobs.emplace_back(box, classify_color(mean(source(boundingRect(contour)))));
         }
     }
 
-    auto filter_lightblobs(const std::vector<contour>& contours, const float tilt_max, const range<float> ratio_range,
-                           const range<double> area_range, camp enemy)
-        -> std::tuple<std::vector<lightblob>, std::vector<contour>>
+    void FindLightBlobs(std::vector<contour>& contours, std::vector<lightblob>& lightBlobs, float minRatio,
+                        float maxRatio, float tiltAngle, float minArea, float maxArea, const color_integral& colors,
+                        bool fitEllipse)
     {
-        std::vector<lightblob> positive;
-        std::vector<contour> negative;
+        lightBlobs.clear();
+        if (colors.empty()) return;
 
+        cv::RotatedRect box;
         for (auto& contour : contours)
         {
-            if (contour.size() < 6 || !area_range.contains(contourArea(contour)))
+            if (!MatchLightBlob(contour, minRatio, maxRatio, tiltAngle, minArea, maxArea, box, fitEllipse))
                 continue;
 
-            bool negative_flag = false;
-            cv::RotatedRect ellipse = fitEllipseDirect(contour);
-            cv::RotatedRect box = minAreaRect(contour);
+            lightBlobs.emplace_back(box, classify_color(colors.mean(boundingRect(contour))));
+        }
+    }
+
+    void FindLightBlobs(std::vector<contour>& contours, std::vector<lightblob>& lightBlobs, float minRatio,
+                        float maxRatio, float tiltAngle, float minArea, float maxArea, const camp known,
+                        bool fitEllipse)
+    {
+        lightBlobs.clear();
+
+        cv::RotatedRect box;
+        for (auto& contour : contours)
+        {
+            if (MatchLightBlob(contour, minRatio, maxRatio, tiltAngle, minArea, maxArea, box, fitEllipse))
+                lightBlobs.emplace_back(box, known);
+        }
+    }
+
+    auto filter_lightblobs(const std::vector<contour>& contours, const float tilt_max, const range<float> ratio_range,
+                           const range<double> area_range, camp enemy, lightblob_filter_stats* stats,
+                           const int chunks)
+        -> std::tuple<std::vector<lightblob>, std::vector<contour>>
+    {
+        const detector_config config{tilt_max, ratio_range, area_range, 0, 0, 0, enemy};
+        const auto classify = [&config](const contour& contour, cv::RotatedRect& ellipse,
+                                        lightblob_filter_stats& counters)
+        {
+            return detail::classify_contour(config, contour, ellipse, counters);
+        };
+
+        return classify_contours(contours, enemy, classify, chunks, stats);
+    }
+
+    auto filter_lightblobs(const std::vector<blob_stats>& blobs, const float tilt_max, const range<float> ratio_range,
+                           const range<double> area_range, camp enemy, lightblob_filter_stats* stats)
+        -> std::tuple<std::vector<lightblob>, std::vector<blob_stats>>
+    {
+        return detail::filter_blobs(detector_config{tilt_max, ratio_range, area_range, 0, 0, 0, enemy}, blobs, stats);
+    }
+
+    std::vector<cv::Rect> coarse_windows(const cv::Mat& image, const camp target, const int lower_bound,
+                                         const float tilt_max, const range<float> ratio_range,
+                                         const range<double> area_range, const float margin)
+    {
+        cv::Mat coarse, binary;
+        resize(image, coarse, {image.cols / 2, image.rows / 2}, 0, 0, cv::INTER_AREA);
+        binarize_color(coarse, binary, target, lower_bound);
+        if (binary.empty()) return {};
+
+        // light blobs of far targets are a few pixels at half resolution, too small to trace and fit an ellipse, so
+        // candidates are only tested on their pixel count and bounding box, the refine pass applies the full filter
+        std::vector<cv::Rect> windows;
+        for (const auto& blob : label_blobs(binary))
+        {
+            const cv::Rect& box = blob.bounding_box;
+            if (!area_range.contains(blob.area * 4.0)) continue;
+
+            // a tilted light blob has a squarer bounding box than its ellipse, only the upper ratio is safe to test
+            if (tilt_max < 45 && box.width > box.height) continue;
+            if (box.height > ratio_range.upper_bound * box.width) continue;
+
+            const int padding = std::max(static_cast<int>(static_cast<float>(box.height) * 2 * margin), 4);
+            cv::Rect window(box.x * 2, box.y * 2, box.width * 2, box.height * 2);
+            window -= cv::Point(padding, padding);
+            window += cv::Size(padding * 2, padding * 2);
+            windows.push_back(window & cv::Rect(0, 0, image.cols, image.rows));
+        }
 
-            if (const float ratio =
-                    std::max(ellipse.size.width, ellipse.size.height) /
-                    std::min(ellipse.size.width, ellipse.size.height);
-                !ratio_range.contains(ratio))
-                negative_flag = true;
+        return windows;
+    }
 
-            // Perpendicular to the frame is considered as 90 degrees, tilt left < 90, tilt right > 90
-            if (const float angle = ellipse.angle > 90 ? ellipse.angle - 90 : ellipse.angle + 90;
-                abs(angle - 90) > tilt_max)
-                negative_flag = true;
+    int FindGuidLight(const std::vector<rm::lightblob>& lightBlobs, const cv::Mat& source)
+    {
+        int index = -1;
+        float area_max = 0;
+        for (int i = 0; i < lightBlobs.size(); ++i)
+        {
+            const lightblob& lightBlob = lightBlobs[i];
+            if (lightBlob.target != CAMP_GUIDELIGHT || lightBlob.size.height > lightBlob.size.width * 2) continue;
+            if (lightBlob.size.area() <= area_max) continue;
 
-            if (negative_flag) negative.push_back(contour);
-            else positive.emplace_back(ellipse, enemy);
+            if (!source.empty())
+            {
+                const cv::Rect box = cv::Rect(cv::RotatedRect(lightBlob.center, lightBlob.size, 0).boundingRect()) &
+                    cv::Rect(0, 0, source.cols, source.rows);
+                if (box.empty() || classify_color(mean(source(box))) != CAMP_GUIDELIGHT) continue;
+            }
+
+            index = i;
+            area_max = lightBlob.size.area();
         }
 
-        return {positive, negative};
+        return index;
+    }
+
+    std::vector<lightblob> find_guidelights(const cv::Mat& image, const int lower_bound,
+                                            preprocess_workspace& workspace, const range<float> band,
+                                            const range<double> area_range, const float circularity_min)
+    {
+        const cv::Range rows = guidelight_rows(image, band);
+        if (rows.empty()) return {};
+
+        binarize_color(image.rowRange(rows), CAMP_GUIDELIGHT, lower_bound, workspace);
+        label_blobs(workspace.binary, workspace);
+        return fit_guidelights(workspace, rows.start, area_range, circularity_min);
+    }
+
+    std::vector<lightblob> find_guidelights(const cv::Mat& image, adaptive_threshold& threshold,
+                                            preprocess_workspace& workspace, const range<float> band,
+                                            const range<double> area_range, const float circularity_min)
+    {
+        const cv::Range rows = guidelight_rows(image, band);
+        if (rows.empty()) return {};
+
+        binarize_color(image.rowRange(rows), CAMP_GUIDELIGHT, threshold, workspace);
+        label_blobs(workspace.binary, workspace);
+        return fit_guidelights(workspace, rows.start, area_range, circularity_min);
     }
 
     bool LightBlobOverlap(const std::vector<lightblob>& lightBlobs, const int leftIndex, const int rightIndex)
@@ -111,57 +252,129 @@ namespace rm
         return false;
     }
 
-    std::vector<armour> filter_armours(std::vector<lightblob>& lightblobs,
-                        const float angle_difference_max, const float shear_max, const float lenght_ratio_max,
-                        const camp enemy)
+    overlap_index::overlap_index(const lightblob_set& set) : cx(set.cx)
     {
-        std::vector<armour> armours;
+        levels.push_back(set.cy);
+        for (int width = 1; width < set.size(); width *= 2)
+        {
+            const std::vector<float>& lower = levels.back();
+            std::vector<float> level(lower.size());
+            for (int begin = 0; begin < lower.size(); begin += width * 2)
+            {
+                const auto middle = lower.begin() + std::min<int>(begin + width, lower.size());
+                const auto end = lower.begin() + std::min<int>(begin + width * 2, lower.size());
+                std::merge(lower.begin() + begin, middle, middle, end, level.begin() + begin);
+            }
+            levels.push_back(std::move(level));
+        }
+    }
 
-        if (lightblobs.size() < 2) return {};
+    bool overlap_index::contains(const float x_min, const float x_max, const float y_min, const float y_max) const
+    {
+        int begin = static_cast<int>(std::upper_bound(cx.begin(), cx.end(), x_min) - cx.begin());
+        const int end = static_cast<int>(std::lower_bound(cx.begin(), cx.end(), x_max) - cx.begin());
 
-        for (int i = 0; i < lightblobs.size() - 1; ++i)
+        // cover [begin, end) with the largest aligned blocks, each one sorted by y at its level
+        while (begin < end)
         {
-            if (lightblobs[i].target != enemy)
+            int level = 0;
+            while (level + 1 < levels.size() && begin % (2 << level) == 0 && begin + (2 << level) <= end) ++level;
+
+            const auto first = levels[level].begin() + begin;
+            const auto last = first + (1 << level);
+            if (const auto it = std::upper_bound(first, last, y_min); it != last && *it < y_max)
+                return true;
+            begin += 1 << level;
+        }
+
+        return false;
+    }
+
+    std::uint64_t match_pairs(const lightblob_set& set, const int i, const int begin, const int end,
+                              const float angle_difference_max, const float lenght_ratio_max)
+    {
+        CV_DbgAssert(end - begin <= 64);
+
+        std::uint64_t mask = 0;
+        int j = begin;
+#if CV_SIMD
+        const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+        const cv::v_float32 two = cv::vx_setall_f32(2), ratio_min = cv::vx_setall_f32(lenght_ratio_max),
+                            angle_max = cv::vx_setall_f32(angle_difference_max);
+        const cv::v_float32 cx = cv::vx_setall_f32(set.cx[i]), cy = cv::vx_setall_f32(set.cy[i]),
+                            angle = cv::vx_setall_f32(set.angle[i]), height = cv::vx_setall_f32(set.height[i]);
+        for (; j <= end - lanes; j += lanes)
+        {
+            const cv::v_float32 height_j = cv::vx_load(set.height.data() + j);
+            const cv::v_float32 heights = cv::v_add(height, height_j);
+            const cv::v_float32 x = cv::v_abs(cv::v_sub(cx, cv::vx_load(set.cx.data() + j)));
+            const cv::v_float32 y = cv::v_abs(cv::v_sub(cy, cv::vx_load(set.cy.data() + j)));
+            const cv::v_float32 ratio = cv::v_div(cv::v_min(height, height_j), cv::v_max(height, height_j));
+            const cv::v_float32 angle_difference = cv::v_abs(cv::v_sub(angle, cv::vx_load(set.angle.data() + j)));
+
+            // collect rejections so that NaN compares the same way as the scalar tests
+            const cv::v_float32 reject = cv::v_or(
+                cv::v_or(cv::v_gt(x, cv::v_mul(heights, two)), cv::v_gt(y, cv::v_div(heights, two))),
+                cv::v_or(cv::v_lt(ratio, ratio_min), cv::v_gt(angle_difference, angle_max)));
+            const auto accept = static_cast<std::uint64_t>(~cv::v_signmask(reject) & ((1 << lanes) - 1));
+            mask |= accept << (j - begin);
+        }
+        cv::vx_cleanup();
+#endif
+        for (; j < end; ++j)
+        {
+            const float heights = set.height[i] + set.height[j];
+            if (abs(set.cx[i] - set.cx[j]) > heights * 2) continue;
+            if (abs(set.cy[i] - set.cy[j]) > heights / 2) continue;
+            if (std::min(set.height[i], set.height[j]) / std::max(set.height[i], set.height[j]) < lenght_ratio_max)
                 continue;
-            for (int j = i + 1; j < lightblobs.size(); ++j)
-            {
-                if (lightblobs[j].target != enemy)
-                    continue;
-
-                if (const float angle_difference = abs(lightblobs[i].angle - lightblobs[j].angle);
-                    angle_difference > angle_difference_max)
-                    continue;
-
-                const float y = abs(lightblobs[i].center.y - lightblobs[j].center.y);
-                const float x = abs(lightblobs[i].center.x - lightblobs[j].center.x);
-                const float rect_angle = atan2(y, x) * 180.0f / static_cast<float>(CV_PI);
-                const float shear_i = abs(lightblobs[i].angle > 90
-                                              ? abs(lightblobs[i].angle - rect_angle) - 90
-                                              : abs(180 - lightblobs[i].angle - rect_angle) - 90);
-                const float shear_j = abs(lightblobs[j].angle > 90
-                                              ? abs(lightblobs[j].angle - rect_angle) - 90
-                                              : abs(180 - lightblobs[j].angle - rect_angle) - 90);
-                if (shear_i > shear_max || shear_j > shear_max)
-                    continue;
-
-                float height_i = lightblobs[i].size.height;
-                float height_j = lightblobs[j].size.height;
-                if (const float ratio = std::min(height_i, height_j) / std::max(height_i, height_j);
-                    ratio < lenght_ratio_max)
-                    continue;
-
-                if (abs(lightblobs[i].center.y - lightblobs[j].center.y) >
-                    (lightblobs[i].size.height + lightblobs[j].size.height) / 2)
-                    continue;
-
-                if (abs(lightblobs[i].center.x - lightblobs[j].center.x) >
-                    (lightblobs[i].size.height + lightblobs[j].size.height) * 2)
-                    continue;
-
-                armours.push_back(armour({lightblobs[i], lightblobs[j]}));
-            }
+            if (abs(set.angle[i] - set.angle[j]) > angle_difference_max) continue;
+            mask |= std::uint64_t{1} << (j - begin);
+        }
+
+        return mask;
+    }
+
+    std::vector<lightblob_pair> pair_lightblobs(const lightblob_set& set, const float angle_difference_max,
+                                                const float shear_max, const float lenght_ratio_max,
+                                                const bool reject_overlap)
+    {
+        const detector_config config{
+            0, {0, 0}, {0, 0}, angle_difference_max, shear_max, lenght_ratio_max, CAMP_NEUTRAL, reject_overlap
+        };
+        return detail::pair_lightblobs(config, set);
+    }
+
+    void suppress_pairs(std::vector<lightblob_pair>& pairs, const int top_k)
+    {
+        std::stable_sort(pairs.begin(), pairs.end(), [](const lightblob_pair& a, const lightblob_pair& b)
+        {
+            return a.score > b.score;
+        });
+
+        std::vector<bool> used;
+        int count = 0;
+        for (auto& pair : pairs)
+        {
+            if (top_k > 0 && count >= top_k) break;
+
+            const int last = std::max(pair.first, pair.second);
+            if (used.size() <= last) used.resize(last + 1, false);
+            if (used[pair.first] || used[pair.second]) continue;
+
+            used[pair.first] = used[pair.second] = true;
+            pairs[count++] = pair;
         }
+        pairs.resize(count);
+    }
 
-        return armours;
+    std::vector<armour> filter_armours(std::vector<lightblob>& lightblobs,
+                        const float angle_difference_max, const float shear_max, const float lenght_ratio_max,
+                        const camp enemy, const bool reject_overlap, const int top_k)
+    {
+        const detector_config config{
+            0, {0, 0}, {0, 0}, angle_difference_max, shear_max, lenght_ratio_max, enemy, reject_overlap, top_k
+        };
+        return detail::filter_armours(config, lightblobs);
     }
 }
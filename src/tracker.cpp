@@ -0,0 +1,510 @@
+//
+// Created by yaione on 10/18/26.
+//
+
+#include "tracker.h"
+
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace
+{
+    /// Correct independent (position, velocity) filters observing both states, see rm::track_bank::correct_subset.
+    /// \param x, v       States of each filter.
+    /// \param pp, pv, vv Covariances of each filter.
+    /// \param z0, z1     Measured position and velocity of each filter.
+    /// \param count      Number of filters.
+    /// \param r          Measurement noise variance.
+    void correct_tracks(double* x, double* v, double* pp, double* pv, double* vv, const double* z0, const double* z1,
+                        const int count, const double r)
+    {
+        int i = 0;
+#if CV_SIMD_64F
+        const int lanes = cv::VTraits<cv::v_float64>::vlanes();
+        const cv::v_float64 noise = cv::vx_setall_f64(r), one = cv::vx_setall_f64(1);
+        for (; i <= count - lanes; i += lanes)
+        {
+            const cv::v_float64 p00 = cv::vx_load(pp + i), p01 = cv::vx_load(pv + i), p11 = cv::vx_load(vv + i);
+            const cv::v_float64 s00 = cv::v_add(p00, noise), s11 = cv::v_add(p11, noise);
+            const cv::v_float64 cross = cv::v_mul(p01, p01);
+
+            // K = P (P + R)^-1 in closed form, K is symmetric
+            const cv::v_float64 det = cv::v_sub(cv::v_mul(s00, s11), cross);
+            const cv::v_float64 k00 = cv::v_div(cv::v_sub(cv::v_mul(p00, s11), cross), det);
+            const cv::v_float64 k01 = cv::v_div(cv::v_mul(p01, noise), det);
+            const cv::v_float64 k11 = cv::v_div(cv::v_sub(cv::v_mul(p11, s00), cross), det);
+
+            const cv::v_float64 position = cv::vx_load(x + i), velocity = cv::vx_load(v + i);
+            const cv::v_float64 y0 = cv::v_sub(cv::vx_load(z0 + i), position);
+            const cv::v_float64 y1 = cv::v_sub(cv::vx_load(z1 + i), velocity);
+            cv::v_store(x + i, cv::v_add(position, cv::v_add(cv::v_mul(k00, y0), cv::v_mul(k01, y1))));
+            cv::v_store(v + i, cv::v_add(velocity, cv::v_add(cv::v_mul(k01, y0), cv::v_mul(k11, y1))));
+
+            // Joseph form (I - K) P (I - K)^T + K R K^T
+            const cv::v_float64 a00 = cv::v_sub(one, k00), a01 = cv::v_sub(cv::vx_setzero_f64(), k01);
+            const cv::v_float64 a11 = cv::v_sub(one, k11);
+            const cv::v_float64 m00 = cv::v_add(cv::v_mul(a00, p00), cv::v_mul(a01, p01));
+            const cv::v_float64 m01 = cv::v_add(cv::v_mul(a00, p01), cv::v_mul(a01, p11));
+            const cv::v_float64 m10 = cv::v_add(cv::v_mul(a01, p00), cv::v_mul(a11, p01));
+            const cv::v_float64 m11 = cv::v_add(cv::v_mul(a01, p01), cv::v_mul(a11, p11));
+            cv::v_store(pp + i, cv::v_add(cv::v_add(cv::v_mul(m00, a00), cv::v_mul(m01, a01)),
+                                          cv::v_mul(noise, cv::v_add(cv::v_mul(k00, k00), cv::v_mul(k01, k01)))));
+            cv::v_store(pv + i, cv::v_add(cv::v_add(cv::v_mul(m00, a01), cv::v_mul(m01, a11)),
+                                          cv::v_mul(noise, cv::v_add(cv::v_mul(k00, k01), cv::v_mul(k01, k11)))));
+            cv::v_store(vv + i, cv::v_add(cv::v_add(cv::v_mul(m10, a01), cv::v_mul(m11, a11)),
+                                          cv::v_mul(noise, cv::v_add(cv::v_mul(k01, k01), cv::v_mul(k11, k11)))));
+        }
+        cv::vx_cleanup();
+#endif
+        for (; i < count; ++i)
+        {
+            const double p00 = pp[i], p01 = pv[i], p11 = vv[i];
+            const double s00 = p00 + r, s11 = p11 + r;
+            const double cross = p01 * p01;
+
+            // K = P (P + R)^-1 in closed form, K is symmetric
+            const double det = s00 * s11 - cross;
+            const double k00 = (p00 * s11 - cross) / det;
+            const double k01 = p01 * r / det;
+            const double k11 = (p11 * s00 - cross) / det;
+
+            const double y0 = z0[i] - x[i], y1 = z1[i] - v[i];
+            x[i] = x[i] + (k00 * y0 + k01 * y1);
+            v[i] = v[i] + (k01 * y0 + k11 * y1);
+
+            // Joseph form (I - K) P (I - K)^T + K R K^T
+            const double a00 = 1 - k00, a01 = 0 - k01, a11 = 1 - k11;
+            const double m00 = a00 * p00 + a01 * p01, m01 = a00 * p01 + a01 * p11;
+            const double m10 = a01 * p00 + a11 * p01, m11 = a01 * p01 + a11 * p11;
+            pp[i] = (m00 * a00 + m01 * a01) + r * (k00 * k00 + k01 * k01);
+            pv[i] = (m00 * a01 + m01 * a11) + r * (k00 * k01 + k01 * k11);
+            vv[i] = (m10 * a01 + m11 * a11) + r * (k01 * k01 + k11 * k11);
+        }
+    }
+}
+
+namespace rm
+{
+    void box_set::assign(const std::vector<armour>& armours, int count)
+    {
+        if (count < 0 || count > armours.size()) count = static_cast<int>(armours.size());
+
+        x.resize(count);
+        y.resize(count);
+        width.resize(count);
+        height.resize(count);
+        for (int i = 0; i < count; ++i)
+        {
+            x[i] = armours[i].bounding_box.x;
+            y[i] = armours[i].bounding_box.y;
+            width[i] = armours[i].bounding_box.width;
+            height[i] = armours[i].bounding_box.height;
+        }
+    }
+
+    void iou_matrix(const box_set& rows, const box_set& cols, std::vector<float>& iou, std::vector<int>* argmax)
+    {
+        const int row_count = rows.size(), col_count = cols.size();
+        iou.resize(static_cast<size_t>(row_count) * col_count);
+        if (argmax) argmax->assign(row_count, -1);
+
+        // intersection and union computed as cv::Rect2f does, empty overlaps count as zero
+        for (int i = 0; i < row_count; ++i)
+        {
+            const float x0 = rows.x[i], y0 = rows.y[i];
+            const float x1 = x0 + rows.width[i], y1 = y0 + rows.height[i];
+            const float area = rows.width[i] * rows.height[i];
+            float* dst = iou.data() + static_cast<size_t>(i) * col_count;
+
+            int j = 0;
+#if CV_SIMD
+            const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+            const cv::v_float32 zero = cv::vx_setzero_f32();
+            const cv::v_float32 left = cv::vx_setall_f32(x0), top = cv::vx_setall_f32(y0);
+            const cv::v_float32 right = cv::vx_setall_f32(x1), bottom = cv::vx_setall_f32(y1);
+            const cv::v_float32 row_area = cv::vx_setall_f32(area);
+            for (; j <= col_count - lanes; j += lanes)
+            {
+                const cv::v_float32 x = cv::vx_load(cols.x.data() + j), y = cv::vx_load(cols.y.data() + j);
+                const cv::v_float32 width = cv::vx_load(cols.width.data() + j);
+                const cv::v_float32 height = cv::vx_load(cols.height.data() + j);
+
+                const cv::v_float32 inner_left = cv::v_max(left, x), inner_top = cv::v_max(top, y);
+                const cv::v_float32 inner_width = cv::v_sub(cv::v_min(right, cv::v_add(x, width)), inner_left);
+                const cv::v_float32 inner_height = cv::v_sub(cv::v_min(bottom, cv::v_add(y, height)), inner_top);
+                const cv::v_float32 overlap = cv::v_and(cv::v_gt(inner_width, zero), cv::v_gt(inner_height, zero));
+                const cv::v_float32 intersection = cv::v_select(overlap, cv::v_mul(inner_width, inner_height), zero);
+
+                const cv::v_float32 union_area =
+                    cv::v_sub(cv::v_add(row_area, cv::v_mul(width, height)), intersection);
+                cv::v_store(dst + j, cv::v_select(cv::v_gt(union_area, zero), cv::v_div(intersection, union_area),
+                                                  zero));
+            }
+            cv::vx_cleanup();
+#endif
+            for (; j < col_count; ++j)
+            {
+                const float inner_left = std::max(x0, cols.x[j]), inner_top = std::max(y0, cols.y[j]);
+                const float inner_width = std::min(x1, cols.x[j] + cols.width[j]) - inner_left;
+                const float inner_height = std::min(y1, cols.y[j] + cols.height[j]) - inner_top;
+                const float intersection = inner_width > 0 && inner_height > 0 ? inner_width * inner_height : 0;
+                const float union_area = area + cols.width[j] * cols.height[j] - intersection;
+                dst[j] = union_area > 0 ? intersection / union_area : 0;
+            }
+
+            if (!argmax) continue;
+            float max = 0;
+            for (j = 0; j < col_count; ++j)
+            {
+                if (dst[j] > max)
+                {
+                    max = dst[j];
+                    (*argmax)[i] = j;
+                }
+            }
+        }
+    }
+
+    track_bank::track_bank(const int capacity, const double process_noise, const double measurement_noise,
+                           const double error) :
+        process_noise(process_noise), measurement_noise(measurement_noise), error(error)
+    {
+        for (auto& state : axes)
+        {
+            for (auto* values : {&state.position, &state.velocity, &state.pp, &state.pv, &state.vv, &state.measured})
+                values->resize(capacity);
+        }
+        measured_at.resize(capacity);
+
+        for (auto* values : {&gathered.position, &gathered.velocity, &gathered.pp, &gathered.pv, &gathered.vv,
+                             &gathered.measured, &gathered_velocity})
+            values->resize(capacity);
+    }
+
+    int track_bank::add(const cv::Point3d& position, const int64 timestamp)
+    {
+        if (count >= static_cast<int>(measured_at.size())) return -1;
+
+        const int index = count++;
+        const double values[3] = {position.x, position.y, position.z};
+        for (int a = 0; a < 3; ++a)
+        {
+            // the position is the measurement with its noise, the velocity is unobserved and starts at the initial
+            // error
+            axes[a].position[index] = axes[a].measured[index] = values[a];
+            axes[a].velocity[index] = 0;
+            axes[a].pp[index] = measurement_noise;
+            axes[a].pv[index] = 0;
+            axes[a].vv[index] = error;
+        }
+        measured_at[index] = timestamp;
+        return index;
+    }
+
+    void track_bank::move(const int from, const int to)
+    {
+        for (auto& state : axes)
+        {
+            for (auto* values : {&state.position, &state.velocity, &state.pp, &state.pv, &state.vv, &state.measured})
+                (*values)[to] = (*values)[from];
+        }
+        measured_at[to] = measured_at[from];
+    }
+
+    void track_bank::resize(const int count)
+    {
+        this->count = std::clamp(count, 0, static_cast<int>(measured_at.size()));
+    }
+
+    void track_bank::predict_all(const double dt)
+    {
+        // per axis F = [1 dt; 0 1], P = F P F^T + Q on the (pp, pv, vv) entries
+        const double dt2 = dt * dt, q = process_noise;
+        for (auto& state : axes)
+        {
+            double* position = state.position.data();
+            double* velocity = state.velocity.data();
+            double* pp = state.pp.data();
+            double* pv = state.pv.data();
+            double* vv = state.vv.data();
+
+            int i = 0;
+#if CV_SIMD_64F
+            const int lanes = cv::VTraits<cv::v_float64>::vlanes();
+            const cv::v_float64 step = cv::vx_setall_f64(dt), step2 = cv::vx_setall_f64(dt2);
+            const cv::v_float64 twice = cv::vx_setall_f64(2 * dt), noise = cv::vx_setall_f64(q);
+            for (; i <= count - lanes; i += lanes)
+            {
+                const cv::v_float64 v = cv::vx_load(velocity + i);
+                const cv::v_float64 cross = cv::vx_load(pv + i), variance = cv::vx_load(vv + i);
+
+                cv::v_store(position + i, cv::v_add(cv::vx_load(position + i), cv::v_mul(v, step)));
+                cv::v_store(pp + i, cv::v_add(cv::v_add(cv::vx_load(pp + i), cv::v_mul(cross, twice)),
+                                              cv::v_add(cv::v_mul(variance, step2), noise)));
+                cv::v_store(pv + i, cv::v_add(cross, cv::v_mul(variance, step)));
+                cv::v_store(vv + i, cv::v_add(variance, noise));
+            }
+            cv::vx_cleanup();
+#endif
+            for (; i < count; ++i)
+            {
+                position[i] = position[i] + velocity[i] * dt;
+                pp[i] = (pp[i] + pv[i] * (2 * dt)) + (vv[i] * dt2 + q);
+                pv[i] = pv[i] + vv[i] * dt;
+                vv[i] = vv[i] + q;
+            }
+        }
+    }
+
+    void track_bank::correct_subset(const int* indices, const cv::Point3d* positions, const int64* timestamps,
+                                    const int subset)
+    {
+        CV_DbgAssert(subset <= static_cast<int>(measured_at.size()));
+
+        for (int a = 0; a < 3; ++a)
+        {
+            axis& state = axes[a];
+            for (int k = 0; k < subset; ++k)
+            {
+                const int index = indices[k];
+                const double dt = static_cast<double>(timestamps[k] - measured_at[index]) / cv::getTickFrequency();
+                const double value = a == 0 ? positions[k].x : a == 1 ? positions[k].y : positions[k].z;
+
+                gathered.position[k] = state.position[index];
+                gathered.velocity[k] = state.velocity[index];
+                gathered.pp[k] = state.pp[index];
+                gathered.pv[k] = state.pv[index];
+                gathered.vv[k] = state.vv[index];
+                gathered.measured[k] = value;
+
+                // without elapsed time the velocity is not observed, measure the current estimate
+                gathered_velocity[k] = dt > 0 ? (value - state.measured[index]) / dt : state.velocity[index];
+            }
+
+            correct_tracks(gathered.position.data(), gathered.velocity.data(), gathered.pp.data(),
+                           gathered.pv.data(), gathered.vv.data(), gathered.measured.data(), gathered_velocity.data(),
+                           subset, measurement_noise);
+
+            for (int k = 0; k < subset; ++k)
+            {
+                const int index = indices[k];
+                state.position[index] = gathered.position[k];
+                state.velocity[index] = gathered.velocity[k];
+                state.pp[index] = gathered.pp[k];
+                state.pv[index] = gathered.pv[k];
+                state.vv[index] = gathered.vv[k];
+                state.measured[index] = gathered.measured[k];
+            }
+        }
+
+        for (int k = 0; k < subset; ++k) measured_at[indices[k]] = timestamps[k];
+    }
+
+    cv::Point3d track_bank::position(const int index) const
+    {
+        return {axes[0].position[index], axes[1].position[index], axes[2].position[index]};
+    }
+
+    cv::Point3d track_bank::velocity(const int index) const
+    {
+        return {axes[0].velocity[index], axes[1].velocity[index], axes[2].velocity[index]};
+    }
+
+    tracker::tracker(const int capacity, const float iou_min, const double distance_max, const int lost_max) :
+        bank(std::max(capacity, 1)), capacity(std::max(capacity, 1)), iou_min(iou_min), distance_max(distance_max),
+        lost_max(lost_max)
+    {
+        const int size = this->capacity;
+        tracks.reserve(size);
+        corrected.reserve(size);
+        measured_positions.reserve(size);
+        measured_at.reserve(size);
+        iou.reserve(size * size);
+        cost.reserve(size * size);
+        assignment.reserve(size);
+        detection_matched.reserve(size);
+        u.reserve(size + 1);
+        v.reserve(size + 1);
+        slack.reserve(size + 1);
+        row_of.reserve(size + 1);
+        previous.reserve(size + 1);
+        visited.reserve(size + 1);
+    }
+
+    double tracker::match_cost(const float iou, const double distance) const
+    {
+        if (iou < iou_min && distance > distance_max) return gated;
+
+        return (1 - iou) + std::min(distance / distance_max, 1.0);
+    }
+
+    void tracker::solve(const int rows, const int cols, const bool transposed)
+    {
+        // Hungarian method with potentials on a rows x cols matrix (rows <= cols), indices are 1-based with column 0
+        // as the virtual start
+        const auto at = [&](const int row, const int col)
+        {
+            return transposed ? cost[(col - 1) * rows + row - 1] : cost[(row - 1) * cols + col - 1];
+        };
+        constexpr double infinity = std::numeric_limits<double>::infinity();
+
+        u.assign(rows + 1, 0);
+        v.assign(cols + 1, 0);
+        row_of.assign(cols + 1, 0);
+        previous.assign(cols + 1, 0);
+
+        for (int row = 1; row <= rows; ++row)
+        {
+            row_of[0] = row;
+            int col = 0;
+            slack.assign(cols + 1, infinity);
+            visited.assign(cols + 1, false);
+
+            do
+            {
+                visited[col] = true;
+                const int current = row_of[col];
+                double delta = infinity;
+                int next = 0;
+                for (int j = 1; j <= cols; ++j)
+                {
+                    if (visited[j]) continue;
+                    if (const double reduced = at(current, j) - u[current] - v[j]; reduced < slack[j])
+                    {
+                        slack[j] = reduced;
+                        previous[j] = col;
+                    }
+                    if (slack[j] < delta)
+                    {
+                        delta = slack[j];
+                        next = j;
+                    }
+                }
+                for (int j = 0; j <= cols; ++j)
+                {
+                    if (visited[j])
+                    {
+                        u[row_of[j]] += delta;
+                        v[j] -= delta;
+                    }
+                    else slack[j] -= delta;
+                }
+                col = next;
+            }
+            while (row_of[col] != 0);
+
+            // flip the augmenting path
+            do
+            {
+                const int prior = previous[col];
+                row_of[col] = row_of[prior];
+                col = prior;
+            }
+            while (col != 0);
+        }
+    }
+
+    void tracker::update(const std::vector<armour>& detections)
+    {
+        const int track_count = static_cast<int>(tracks.size());
+        const int detection_count = std::min(static_cast<int>(detections.size()), capacity);
+
+        // bring every filter to the frame time at once
+        if (detection_count > 0)
+        {
+            if (const int64 now = detections.front().timestamp; now > timestamp)
+            {
+                if (track_count > 0)
+                    bank.predict_all(static_cast<double>(now - timestamp) / cv::getTickFrequency());
+                timestamp = now;
+            }
+        }
+
+        assignment.assign(track_count, -1);
+        detection_matched.assign(detection_count, false);
+
+        if (track_count > 0 && detection_count > 0)
+        {
+            track_boxes.assign(tracks);
+            detection_boxes.assign(detections, detection_count);
+            iou_matrix(track_boxes, detection_boxes, iou);
+
+            cost.resize(track_count * detection_count);
+            for (int i = 0; i < track_count; ++i)
+                for (int j = 0; j < detection_count; ++j)
+                    cost[i * detection_count + j] = match_cost(iou[i * detection_count + j],
+                                                               norm(bank.position(i) - detections[j].position));
+
+            // the solver assigns every row, so rows are the smaller side
+            const bool transposed = track_count > detection_count;
+            const int rows = transposed ? detection_count : track_count;
+            const int cols = transposed ? track_count : detection_count;
+            solve(rows, cols, transposed);
+
+            for (int col = 1; col <= cols; ++col)
+            {
+                if (row_of[col] == 0) continue;
+                const int track = transposed ? col - 1 : row_of[col] - 1;
+                const int detection = transposed ? row_of[col] - 1 : col - 1;
+                if (cost[track * detection_count + detection] >= gated) continue;
+
+                assignment[track] = detection;
+                detection_matched[detection] = true;
+            }
+        }
+
+        // correct the matched filters together
+        corrected.clear();
+        measured_positions.clear();
+        measured_at.clear();
+        for (int i = 0; i < track_count; ++i)
+        {
+            if (assignment[i] < 0) continue;
+            corrected.push_back(i);
+            measured_positions.push_back(detections[assignment[i]].position);
+            measured_at.push_back(detections[assignment[i]].timestamp);
+        }
+        bank.correct_subset(corrected.data(), measured_positions.data(), measured_at.data(),
+                            static_cast<int>(corrected.size()));
+
+        // decay the identity votes of every track once per frame, update matched tracks and drop the lost ones,
+        // keeping the order of the survivors
+        int kept = 0;
+        for (int i = 0; i < track_count; ++i)
+        {
+            armour& track = tracks[i];
+            track.decay_votes();
+            if (const int index = assignment[i]; index >= 0)
+            {
+                const armour& detection = detections[index];
+                track.vote(detection.identity);
+                std::copy(detection.icon, detection.icon + 4, track.icon);
+                std::copy(detection.vertices, detection.vertices + 4, track.vertices);
+                track.bounding_box = detection.bounding_box;
+                track.position = detection.position;
+                track.identity = detection.identity;
+                track.timestamp = detection.timestamp;
+                track.lost_count = 0;
+            }
+            else if (track.lost_count++ > lost_max) continue;
+
+            if (kept != i)
+            {
+                tracks[kept] = std::move(track);
+                bank.move(i, kept);
+            }
+            ++kept;
+        }
+        tracks.erase(tracks.begin() + kept, tracks.end());
+        bank.resize(kept);
+
+        // unmatched detections start new tracks while there is room
+        for (int j = 0; j < detection_count && static_cast<int>(tracks.size()) < capacity; ++j)
+        {
+            if (detection_matched[j]) continue;
+            tracks.push_back(detections[j]);
+            tracks.back().lost_count = 0;
+            tracks.back().vote(detections[j].identity);
+            bank.add(detections[j].position, detections[j].timestamp);
+        }
+    }
+}